@@ -23,6 +23,8 @@
 #cmakedefine HAVE_EVP_AES_XTS
 
 #cmakedefine HAVE_LCHMOD
+#cmakedefine HAVE_POSIX_FADVISE
+#cmakedefine HAVE_ZLIB
 
 /* TODO: add other thread library support. */
 #cmakedefine CMAKE_USE_PTHREADS_INIT
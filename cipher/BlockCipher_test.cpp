@@ -138,6 +138,13 @@ TEST_F(BlockCipherTest, TestVectors) {
       "000102030405060708090a0b0c0d0e0f", "6bc1bee22e409f96e93d7e117393172a",
       "3b3fd92eb72dad20333449f8e83cfb4a");
 
+  // AES128 CTR
+  checkTestVector<StreamCipher>(
+      NAME_AES_CTR, "2b7e151628aed2a6abf7158809cf4f3c",
+      "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff",
+      "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51",
+      "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff");
+
   // AES256 CBC
   checkTestVector<BlockCipher>(
       NAME_AES_CBC,
@@ -153,6 +160,78 @@ TEST_F(BlockCipherTest, TestVectors) {
       "dc7e84bfda79164b7ecd8486985d3860");
 }
 
+shared_ptr<CipherV1> sivCipher(const char *hexMacKey, const char *hexCtrKey) {
+  shared_ptr<CipherV1> cipher = CipherV1::New("AES", 128);
+  if (!cipher || !cipher->hasSIV()) return shared_ptr<CipherV1>();
+  if (!cipher->setKey(cipher->newRandomKey())) return shared_ptr<CipherV1>();
+
+  CipherKey macKey(strlen(hexMacKey) / 2);
+  setDataFromHex(macKey.data(), macKey.size(), hexMacKey);
+  CipherKey ctrKey(strlen(hexCtrKey) / 2);
+  setDataFromHex(ctrKey.data(), ctrKey.size(), hexCtrKey);
+  if (!cipher->setSIVKeys(macKey, ctrKey)) return shared_ptr<CipherV1>();
+  return cipher;
+}
+
+void checkCmac(const CipherV1 &cipher, const char *hexMessage,
+               const char *hexMac) {
+  SCOPED_TRACE(testing::Message() << "message = " << hexMessage);
+  int len = strlen(hexMessage) / 2;
+  byte message[len + 1];
+  setDataFromHex(message, len, hexMessage);
+
+  byte mac[CipherV1::SIVTagSize];
+  cipher.cmac(message, len, mac);
+  ASSERT_EQ(hexMac, stringToHex(mac, sizeof(mac)));
+}
+
+TEST_F(BlockCipherTest, CmacTestVectors) {
+  // RFC 4493, section 4.
+  auto cipher = sivCipher("2b7e151628aed2a6abf7158809cf4f3c",
+                          "2b7e151628aed2a6abf7158809cf4f3c");
+  ASSERT_TRUE(cipher != NULL);
+
+  checkCmac(*cipher, "", "bb1d6929e95937287fa37d129b756746");
+  checkCmac(*cipher, "6bc1bee22e409f96e93d7e117393172a",
+            "070a16b46b4d4144f79bdd9dd04a287c");
+  checkCmac(*cipher,
+            "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+            "30c81c46a35ce411",
+            "dfa66747de9ae63030ca32611497c827");
+  checkCmac(*cipher,
+            "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+            "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710",
+            "51f0bebf7e3b9d92fc49741779363cfe");
+}
+
+TEST_F(BlockCipherTest, SivTestVectors) {
+  // RFC 5297, appendix A.1: deterministic authenticated encryption.
+  auto cipher = sivCipher("fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0",
+                          "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+  ASSERT_TRUE(cipher != NULL);
+
+  const char hexAd[] = "101112131415161718191a1b1c1d1e1f2021222324252627";
+  byte ad[sizeof(hexAd) / 2];
+  setDataFromHex(ad, sizeof(ad), hexAd);
+
+  const char hexPlaintext[] = "112233445566778899aabbccddee";
+  byte data[sizeof(hexPlaintext) / 2];
+  setDataFromHex(data, sizeof(data), hexPlaintext);
+
+  byte tag[CipherV1::SIVTagSize];
+  ASSERT_TRUE(cipher->sivEncode(tag, data, sizeof(data), ad, sizeof(ad)));
+  ASSERT_EQ("85632d07c6e8f37f950acd320a2ecc93", stringToHex(tag, sizeof(tag)));
+  ASSERT_EQ("40c02b9690c4dc04daef7f6afe5c", stringToHex(data, sizeof(data)));
+
+  ASSERT_TRUE(cipher->sivDecode(tag, data, sizeof(data), ad, sizeof(ad)));
+  ASSERT_EQ(hexPlaintext, stringToHex(data, sizeof(data)));
+
+  // Any change to the associated data must be detected.
+  ASSERT_TRUE(cipher->sivEncode(tag, data, sizeof(data), ad, sizeof(ad)));
+  ad[0] ^= 1;
+  ASSERT_FALSE(cipher->sivDecode(tag, data, sizeof(data), ad, sizeof(ad)));
+}
+
 TEST_F(BlockCipherTest, BlockEncryptionTest) {
   Registry<BlockCipher> registry = BlockCipher::GetRegistry();
 
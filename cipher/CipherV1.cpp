@@ -43,6 +43,7 @@
 #include "cipher/MAC.h"
 #include "cipher/BlockCipher.h"
 #include "cipher/PBKDF.h"
+#include "cipher/Random.h"
 #include "cipher/StreamCipher.h"
 
 #ifdef WITH_OPENSSL
@@ -249,6 +250,13 @@ bool CipherV1::initCiphers(const Interface &iface, const Interface &realIface,
     defaultKeyLength = AESDefaultKeyLen;
     _blockCipher.reset(blockCipherRegistry.CreateForMatch(NAME_AES_CBC));
     _streamCipher.reset(streamCipherRegistry.CreateForMatch(NAME_AES_CFB));
+    _sivMac.reset(blockCipherRegistry.CreateForMatch(NAME_AES_CBC));
+    _sivCtr.reset(streamCipherRegistry.CreateForMatch(NAME_AES_CTR));
+    if (!_sivMac || !_sivCtr) {
+      VLOG(1) << "AES-SIV not available";
+      _sivMac.reset();
+      _sivCtr.reset();
+    }
   } else if (implements(BlowfishInterface, iface)) {
     keyRange = BFKeyRange;
     defaultKeyLength = BFDefaultKeyLen;
@@ -299,6 +307,10 @@ CipherV1::~CipherV1() {}
 
 Interface CipherV1::interface() const { return realIface; }
 
+bool CipherV1::isNull() const {
+  return implements(NullCipherInterface, realIface);
+}
+
 /*
    Create a key from the password.
    Use SHA to distribute entropy from the password into the key.
@@ -358,6 +370,8 @@ CipherKey CipherV1::newRandomKey() {
 }
 
 bool CipherV1::pseudoRandomize(byte *buf, int len) {
+  // use the per-thread generator, unless it can't be seeded.
+  if (FastRandom::randomize(buf, len)) return true;
   return _pbkdf->pseudoRandom(buf, len);
 }
 
@@ -374,7 +388,7 @@ bool CipherV1::setKey(const CipherKey &keyIv) {
   memcpy(_iv->data(), keyIv.data() + _keySize, _ivLength);
 
   if (_blockCipher->setKey(key) && _streamCipher->setKey(key) &&
-      _hmac->setKey(key)) {
+      _hmac->setKey(key) && (!_sivMac || setSIVKey())) {
     _keySet = true;
     return true;
   }
@@ -382,6 +396,202 @@ bool CipherV1::setKey(const CipherKey &keyIv) {
   return false;
 }
 
+// Double a value in GF(2^128), as used by CMAC and S2V.
+static void sivDouble(byte *block) {
+  byte carry = block[0] >> 7;
+  for (int i = 0; i < 15; ++i)
+    block[i] = (byte)((block[i] << 1) | (block[i + 1] >> 7));
+  block[15] = (byte)((block[15] << 1) ^ (carry ? 0x87 : 0));
+}
+
+static void xorBlock(byte *out, const byte *in) {
+  for (int i = 0; i < CipherV1::SIVTagSize; ++i) out[i] ^= in[i];
+}
+
+// Called from setKey, with the HMAC lock held and the HMAC already keyed
+// with the volume key.
+bool CipherV1::setSIVKey() {
+  // Derive separate MAC and CTR keys from the volume key, using the HMAC as
+  // a PRF, so the SIV ciphers never share a key with the block and stream
+  // ciphers.
+  static const char label[] = "encfs/siv";
+  CipherKey macKey(_keySize);
+  CipherKey ctrKey(_keySize);
+  SecureMem md(_hmac->outputSize());
+  SecureMem material(2 * _keySize);
+  for (int offset = 0, counter = 1; offset < material.size(); ++counter) {
+    byte c = (byte)counter;
+    _hmac->init();
+    _hmac->update(reinterpret_cast<const byte *>(label), sizeof(label) - 1);
+    _hmac->update(&c, 1);
+    _hmac->write(md.data());
+
+    int toCopy = MIN(md.size(), material.size() - offset);
+    memcpy(material.data() + offset, md.data(), toCopy);
+    offset += toCopy;
+  }
+  memcpy(macKey.data(), material.data(), _keySize);
+  memcpy(ctrKey.data(), material.data() + _keySize, _keySize);
+
+  return setSIVKeys(macKey, ctrKey);
+}
+
+bool CipherV1::setSIVKeys(const CipherKey &macKey, const CipherKey &ctrKey) {
+  rAssert(hasSIV());
+  if (!_sivMac->setKey(macKey) || !_sivCtr->setKey(ctrKey)) return false;
+
+  // CMAC subkeys K1 and K2, from the encrypted zero block.
+  _sivSubkeys.reset(new SecureMem(2 * SIVTagSize));
+  byte *k1 = _sivSubkeys->data();
+  byte *k2 = k1 + SIVTagSize;
+  byte zero[SIVTagSize] = {0};
+  if (!_sivMac->encrypt(zero, zero, k1, SIVTagSize)) return false;
+  sivDouble(k1);
+  memcpy(k2, k1, SIVTagSize);
+  sivDouble(k2);
+  return true;
+}
+
+bool CipherV1::hasSIV() const { return _sivMac && _sivCtr; }
+
+// AES-CMAC, computed as the last block of a CBC encryption with a zero IV.
+void CipherV1::cmac(const byte *data, int len, byte *out) const {
+  int blocks = (len + SIVTagSize - 1) / SIVTagSize;
+  if (blocks == 0) blocks = 1;
+
+  vector<byte> buf(blocks * SIVTagSize, 0);
+  if (len > 0) memcpy(buf.data(), data, len);
+
+  byte *last = buf.data() + (blocks - 1) * SIVTagSize;
+  const byte *subkey = _sivSubkeys->data();
+  if (len == 0 || len % SIVTagSize != 0) {
+    buf[len] = 0x80;
+    subkey += SIVTagSize;
+  }
+  xorBlock(last, subkey);
+
+  byte zero[SIVTagSize] = {0};
+  bool ok = _sivMac->encrypt(zero, buf.data(), buf.data(), buf.size());
+  rAssert(ok);
+  memcpy(out, last, SIVTagSize);
+}
+
+// S2V from RFC 5297, with at most one associated data string.
+void CipherV1::s2v(const byte *ad, int adLen, const byte *data, int len,
+                   byte *out) const {
+  byte d[SIVTagSize] = {0};
+  cmac(d, SIVTagSize, d);
+
+  if (ad) {
+    byte mac[SIVTagSize];
+    cmac(ad, adLen, mac);
+    sivDouble(d);
+    xorBlock(d, mac);
+  }
+
+  if (len >= SIVTagSize) {
+    vector<byte> t(data, data + len);
+    xorBlock(t.data() + len - SIVTagSize, d);
+    cmac(t.data(), len, out);
+  } else {
+    byte t[SIVTagSize] = {0};
+    memcpy(t, data, len);
+    t[len] = 0x80;
+    sivDouble(d);
+    xorBlock(t, d);
+    cmac(t, SIVTagSize, out);
+  }
+}
+
+// The chained IV is passed to S2V as 8 little-endian bytes.
+static void sivChainBytes(uint64_t value, byte *out) {
+  for (int i = 0; i < 8; ++i) {
+    out[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+static uint64_t sivChainValue(const byte *tag) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) value = (value << 8) | (uint64_t)tag[i];
+  return value;
+}
+
+// The counter is the tag, with two bits cleared to allow for 32 bit
+// counter implementations.
+static void sivCounter(const byte *tag, byte *ctr) {
+  memcpy(ctr, tag, CipherV1::SIVTagSize);
+  ctr[8] &= 0x7f;
+  ctr[12] &= 0x7f;
+}
+
+bool CipherV1::sivEncode(byte *tag, byte *data, int len,
+                         uint64_t *chainedIV) const {
+  byte h[8];
+  if (chainedIV) sivChainBytes(*chainedIV, h);
+  if (!sivEncode(tag, data, len, chainedIV ? h : NULL, sizeof(h)))
+    return false;
+
+  if (chainedIV) *chainedIV = sivChainValue(tag);
+  return true;
+}
+
+bool CipherV1::sivDecode(const byte *tag, byte *data, int len,
+                         uint64_t *chainedIV) const {
+  byte h[8];
+  if (chainedIV) sivChainBytes(*chainedIV, h);
+  if (!sivDecode(tag, data, len, chainedIV ? h : NULL, sizeof(h)))
+    return false;
+
+  if (chainedIV) *chainedIV = sivChainValue(tag);
+  return true;
+}
+
+bool CipherV1::sivEncode(byte *tag, byte *data, int len, const byte *ad,
+                         int adLen) const {
+  rAssert(_keySet);
+  rAssert(hasSIV());
+  rAssert(len > 0);
+
+  s2v(ad, adLen, data, len, tag);
+
+  byte ctr[SIVTagSize];
+  sivCounter(tag, ctr);
+  return _sivCtr->encrypt(ctr, data, data, len);
+}
+
+bool CipherV1::sivDecode(const byte *tag, byte *data, int len, const byte *ad,
+                         int adLen) const {
+  rAssert(_keySet);
+  rAssert(hasSIV());
+  rAssert(len > 0);
+
+  byte ctr[SIVTagSize];
+  sivCounter(tag, ctr);
+  if (!_sivCtr->decrypt(ctr, data, data, len)) return false;
+
+  byte check[SIVTagSize];
+  s2v(ad, adLen, data, len, check);
+
+  byte diff = 0;
+  for (int i = 0; i < SIVTagSize; ++i) diff |= check[i] ^ tag[i];
+  return diff == 0;
+}
+
+// chop a MAC down to a 64bit value..
+static uint64_t foldMac(const byte *md, int size) {
+  byte h[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+  // XXX: the last byte off the hmac isn't used.  This minor inconsistency
+  // must be maintained in order to maintain backward compatiblity with earlier
+  // releases.
+  for (int i = 0; i < size - 1; ++i) h[i % 8] ^= (byte)(md[i]);
+
+  uint64_t value = (uint64_t)h[0];
+  for (int i = 1; i < 8; ++i) value = (value << 8) | (uint64_t)h[i];
+  return value;
+}
+
 uint64_t CipherV1::MAC_64(const byte *data, int len,
                           uint64_t *chainedIV) const {
   rAssert(len > 0);
@@ -408,16 +618,7 @@ uint64_t CipherV1::MAC_64(const byte *data, int len,
   bool ok = _hmac->write(md);
   rAssert(ok);
 
-  // chop this down to a 64bit value..
-  byte h[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-
-  // XXX: the last byte off the hmac isn't used.  This minor inconsistency
-  // must be maintained in order to maintain backward compatiblity with earlier
-  // releases.
-  for (int i = 0; i < _hmac->outputSize() - 1; ++i) h[i % 8] ^= (byte)(md[i]);
-
-  uint64_t value = (uint64_t)h[0];
-  for (int i = 1; i < 8; ++i) value = (value << 8) | (uint64_t)h[i];
+  uint64_t value = foldMac(md, _hmac->outputSize());
 
   // TODO: should not be here.
   if (chainedIV) *chainedIV = value;
@@ -425,6 +626,26 @@ uint64_t CipherV1::MAC_64(const byte *data, int len,
   return value;
 }
 
+void CipherV1::MAC_64(const byte *const *src, const int *lengths, int count,
+                      uint64_t *macs) const {
+  rAssert(_keySet);
+  if (count <= 0) return;
+
+  int size = _hmac->outputSize();
+  vector<byte> md(count * size);
+
+  if (_hmac->concurrentBatch()) {
+    bool ok = _hmac->computeBatch(src, lengths, count, md.data());
+    rAssert(ok);
+  } else {
+    Lock l(_hmacMutex);
+    bool ok = _hmac->computeBatch(src, lengths, count, md.data());
+    rAssert(ok);
+  }
+
+  for (int i = 0; i < count; ++i) macs[i] = foldMac(md.data() + i * size, size);
+}
+
 unsigned int CipherV1::reduceMac32(uint64_t mac64) {
   return ((mac64 >> 32) & 0xffffffff) ^ (mac64 & 0xffffffff);
 }
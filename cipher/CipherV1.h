@@ -90,6 +90,12 @@ class CipherV1 {
   shared_ptr<SecureMem> _iv;
   bool _keySet;
 
+  // AES-SIV ciphers, keyed separately from the volume key, and the CMAC
+  // subkeys derived from the MAC key.  Only available with AES.
+  shared_ptr<BlockCipher> _sivMac;
+  shared_ptr<StreamCipher> _sivCtr;
+  shared_ptr<SecureMem> _sivSubkeys;
+
  public:
   struct CipherAlgorithm {
     std::string name;
@@ -123,6 +129,9 @@ class CipherV1 {
   // returns the real interface, not the one we're emulating (if any)..
   Interface interface() const;
 
+  // true for the pass-through cipher, which leaves data unchanged.
+  bool isNull() const;
+
   // create a new key based on a password
   CipherKey newKey(const char *password, int passwdLength, int *iterationCount,
                    long desiredDuration, const byte *salt, int saltLen);
@@ -153,6 +162,12 @@ class CipherV1 {
 
   uint64_t MAC_64(const byte *src, int len, uint64_t *augment = NULL) const;
 
+  // MAC_64 of count independent buffers, without chaining, which the MAC
+  // may compute several at a time.  Takes the HMAC lock once for the batch,
+  // or not at all if the MAC's batches may run concurrently.
+  void MAC_64(const byte *const *src, const int *lengths, int count,
+              uint64_t *macs) const;
+
   static unsigned int reduceMac32(uint64_t mac64);
   static unsigned int reduceMac16(uint64_t mac64);
 
@@ -171,8 +186,44 @@ class CipherV1 {
   bool blockEncode(byte *buf, int size, uint64_t iv64) const;
   bool blockDecode(byte *buf, int size, uint64_t iv64) const;
 
+  /*
+     Deterministic authenticated encoding in-place, using AES-SIV (RFC 5297).
+     The synthetic IV is an AES-CMAC over the chained IV (if any) and the
+     data, which is then encrypted in a single AES-CTR pass.  The tag must
+     hold SIVTagSize bytes.  If chainedIV is given, it is included in the
+     MAC and replaced with the first 64 bits of the tag.
+
+     Doesn't use the HMAC, so it doesn't take the HMAC lock.  Decoding
+     returns false if the tag doesn't match.
+   */
+  static const int SIVTagSize = 16;
+  bool hasSIV() const;
+  bool sivEncode(byte *tag, byte *data, int len, uint64_t *chainedIV) const;
+  bool sivDecode(const byte *tag, byte *data, int len,
+                 uint64_t *chainedIV) const;
+
+  // The same, with a single associated data string in place of the chained
+  // IV.  A NULL ad means no associated data.
+  bool sivEncode(byte *tag, byte *data, int len, const byte *ad,
+                 int adLen) const;
+  bool sivDecode(const byte *tag, byte *data, int len, const byte *ad,
+                 int adLen) const;
+
+  // Replaces the SIV keys which setKey derives from the volume key.  Both
+  // must be keySize() bytes.  Used for the RFC 5297 test vectors.
+  bool setSIVKeys(const CipherKey &macKey, const CipherKey &ctrKey);
+
+  // AES-CMAC (RFC 4493) under the SIV MAC key.  out must hold SIVTagSize
+  // bytes.
+  void cmac(const byte *data, int len, byte *out) const;
+
  private:
   void setIVec(byte *out, uint64_t seed) const;
+
+  // derives the SIV keys from the volume key, through the keyed HMAC.
+  bool setSIVKey();
+  void s2v(const byte *ad, int adLen, const byte *data, int len,
+           byte *out) const;
 };
 
 }  // namespace encfs
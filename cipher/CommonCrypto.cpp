@@ -120,22 +120,25 @@ class CCCipher : public BlockCipher {
   CipherKey key;
   CCAlgorithm algorithm;
   CCMode mode;
+  CCModeOptions options;
 
  public:
   CCCipher() {}
   virtual ~CCCipher() {}
 
-  bool rekey(const CipherKey &key, CCAlgorithm algorithm, CCMode mode) {
+  bool rekey(const CipherKey &key, CCAlgorithm algorithm, CCMode mode,
+             CCModeOptions options = 0) {
     this->key = key;
     this->algorithm = algorithm;
     this->mode = mode;
+    this->options = options;
     return true;
   }
 
   virtual bool encrypt(const byte *iv, const byte *in, byte *out, int size) {
     CCCryptorRef cryptor;
     CCCryptorCreateWithMode(kCCEncrypt, mode, algorithm, 0, iv, key.data(),
-                            key.size(), NULL, 0, 0, 0, &cryptor);
+                            key.size(), NULL, 0, 0, options, &cryptor);
     size_t updateLength = 0;
     CCCryptorUpdate(cryptor, in, size, out, size, &updateLength);
     CCCryptorRelease(cryptor);
@@ -145,7 +148,7 @@ class CCCipher : public BlockCipher {
   virtual bool decrypt(const byte *iv, const byte *in, byte *out, int size) {
     CCCryptorRef cryptor;
     CCCryptorCreateWithMode(kCCDecrypt, mode, algorithm, 0, iv, key.data(),
-                            key.size(), NULL, 0, 0, 0, &cryptor);
+                            key.size(), NULL, 0, 0, options, &cryptor);
     size_t updateLength = 0;
     CCCryptorUpdate(cryptor, in, size, out, size, &updateLength);
     CCCryptorRelease(cryptor);
@@ -221,6 +224,24 @@ class AesCfb : public CCCipher {
 };
 REGISTER_CLASS(AesCfb, StreamCipher);
 
+class AesCtr : public CCCipher {
+ public:
+  AesCtr() {}
+  virtual ~AesCtr() {}
+
+  virtual bool setKey(const CipherKey &key) {
+    return CCCipher::rekey(key, kCCAlgorithmAES128, kCCModeCTR,
+                           kCCModeOptionCTR_BE);
+  }
+
+  virtual int blockSize() const { return 1; }
+
+  static Properties GetProperties() {
+    return Properties(Range(128, 256, 64), "AES", "CTR", "CommonCrypto");
+  }
+};
+REGISTER_CLASS(AesCtr, StreamCipher);
+
 class Sha1HMac : public MAC {
  public:
   Sha1HMac() {}
@@ -8,4 +8,16 @@ MAC::MAC() {}
 
 MAC::~MAC() {}
 
+bool MAC::computeBatch(const byte *const *in, const int *lengths, int count,
+                       byte *out) {
+  for (int i = 0; i < count; ++i) {
+    init();
+    if (!update(in[i], lengths[i])) return false;
+    if (!write(out + i * outputSize())) return false;
+  }
+  return true;
+}
+
+bool MAC::concurrentBatch() const { return false; }
+
 }  // namespace encfs
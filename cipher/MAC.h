@@ -36,6 +36,17 @@ class MAC {
   virtual void init() = 0;
   virtual bool update(const byte *in, int length) = 0;
   virtual bool write(byte *out) = 0;
+
+  // Compute the MAC of count independent messages, writing outputSize()
+  // bytes per message to out.  The result is the same as init(), update()
+  // and write() for each message, which is what the default does.
+  // Implementations may compute several messages at once.
+  virtual bool computeBatch(const byte *const *in, const int *lengths,
+                            int count, byte *out);
+
+  // True if computeBatch leaves the init/update/write state alone, so it
+  // may run in several threads at once.  Not with setKey, though.
+  virtual bool concurrentBatch() const;
 };
 
 }  // namespace encfs
@@ -23,6 +23,9 @@
 
 #include <gtest/gtest.h>
 
+#include <thread>
+#include <vector>
+
 #include "base/shared_ptr.h"
 #include "cipher/MAC.h"
 #include "cipher/testing.h"
@@ -79,4 +82,81 @@ TEST(HMacSha1Test, MAC) {
   ASSERT_EQ("e8e99d0f45237d786d6bbaa7965c7808bbff1a91", stringToHex(out, 20));
 }
 
+TEST(HMacSha1Test, Batch) {
+  Registry<MAC> registry = MAC::GetRegistry();
+  shared_ptr<MAC> hmac(registry.CreateForMatch(NAME_SHA1_HMAC));
+  ASSERT_FALSE(!hmac);
+
+  // messages of many lengths, around the block and padding boundaries.
+  const int count = 150;
+  byte data[count];
+  const byte *in[count];
+  int lengths[count];
+  for (int i = 0; i < count; ++i) {
+    data[i] = i * 7;
+    in[i] = data;
+    lengths[i] = i;
+  }
+
+  for (int keyLen : {0, 20, 80}) {
+    CipherKey key(keyLen);
+    if (keyLen > 0) memset(key.data(), 0x5c, keyLen);
+    hmac->setKey(key);
+
+    byte batch[count * 20];
+    ASSERT_TRUE(hmac->computeBatch(in, lengths, count, batch));
+
+    for (int i = 0; i < count; ++i) {
+      byte out[20];
+      hmac->init();
+      hmac->update(in[i], lengths[i]);
+      hmac->write(out);
+      ASSERT_EQ(stringToHex(out, 20), stringToHex(batch + i * 20, 20))
+          << "key length " << keyLen << ", message length " << lengths[i];
+    }
+  }
+}
+
+TEST(HMacSha1Test, ConcurrentBatch) {
+  Registry<MAC> registry = MAC::GetRegistry();
+  shared_ptr<MAC> hmac(registry.CreateForMatch(NAME_SHA1_HMAC));
+  ASSERT_FALSE(!hmac);
+  if (!hmac->concurrentBatch()) return;
+
+  const int count = 64;
+  byte data[count];
+  const byte *in[count];
+  int lengths[count];
+  for (int i = 0; i < count; ++i) {
+    data[i] = i * 7;
+    in[i] = data;
+    lengths[i] = i;
+  }
+
+  CipherKey key(20);
+  memset(key.data(), 0x5c, key.size());
+  hmac->setKey(key);
+  byte expected[count * 20];
+  ASSERT_TRUE(hmac->computeBatch(in, lengths, count, expected));
+
+  // batches from several threads at once, without any lock.
+  const int threads = 4;
+  byte results[threads][count * 20];
+  bool ok[threads];
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.push_back(std::thread([&, t] {
+      ok[t] = true;
+      for (int n = 0; n < 50 && ok[t]; ++n)
+        ok[t] = hmac->computeBatch(in, lengths, count, results[t]);
+    }));
+  }
+  for (auto &w : workers) w.join();
+
+  for (int t = 0; t < threads; ++t) {
+    ASSERT_TRUE(ok[t]);
+    ASSERT_EQ(0, memcmp(expected, results[t], sizeof(expected)));
+  }
+}
+
 }  // namespace
@@ -0,0 +1,220 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cipher/Random.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <glog/logging.h>
+
+namespace encfs {
+
+static const int KeyBytes = 32;
+static const int BlockBytes = 64;
+
+// Blocks produced per refill.  The first KeyBytes of each refill become the
+// next key, the rest is handed out.
+static const int RefillBlocks = 16;
+static const int BufferBytes = RefillBlocks * BlockBytes;
+
+static inline uint32_t rotl(uint32_t v, int n) {
+  return (v << n) | (v >> (32 - n));
+}
+
+static inline uint32_t load32(const byte *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static inline void store32(byte *p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+#define QUARTERROUND(a, b, c, d) \
+  a += b;                        \
+  d = rotl(d ^ a, 16);           \
+  c += d;                        \
+  b = rotl(b ^ c, 12);           \
+  a += b;                        \
+  d = rotl(d ^ a, 8);            \
+  c += d;                        \
+  b = rotl(b ^ c, 7);
+
+void FastRandom::chachaBlock(const byte *key, unsigned long long counter,
+                             unsigned long long nonce, byte *out) {
+  uint32_t input[16];
+  input[0] = 0x61707865;  // "expand 32-byte k"
+  input[1] = 0x3320646e;
+  input[2] = 0x79622d32;
+  input[3] = 0x6b206574;
+  for (int i = 0; i < 8; ++i) input[4 + i] = load32(key + 4 * i);
+  input[12] = (uint32_t)counter;
+  input[13] = (uint32_t)(counter >> 32);
+  input[14] = (uint32_t)nonce;
+  input[15] = (uint32_t)(nonce >> 32);
+
+  uint32_t x[16];
+  memcpy(x, input, sizeof(x));
+  for (int i = 0; i < 10; ++i) {
+    QUARTERROUND(x[0], x[4], x[8], x[12]);
+    QUARTERROUND(x[1], x[5], x[9], x[13]);
+    QUARTERROUND(x[2], x[6], x[10], x[14]);
+    QUARTERROUND(x[3], x[7], x[11], x[15]);
+    QUARTERROUND(x[0], x[5], x[10], x[15]);
+    QUARTERROUND(x[1], x[6], x[11], x[12]);
+    QUARTERROUND(x[2], x[7], x[8], x[13]);
+    QUARTERROUND(x[3], x[4], x[9], x[14]);
+  }
+
+  for (int i = 0; i < 16; ++i) store32(out + 4 * i, x[i] + input[i]);
+
+  memset(x, 0, sizeof(x));
+  memset(input, 0, sizeof(input));
+}
+
+#undef QUARTERROUND
+
+static bool readSystemRandom(byte *buf, int len) {
+  int fd = ::open("/dev/urandom", O_RDONLY);
+  if (fd < 0) {
+    PLOG(ERROR) << "unable to open /dev/urandom";
+    return false;
+  }
+
+  while (len > 0) {
+    ssize_t res = ::read(fd, buf, len);
+    if (res < 0 && errno == EINTR) continue;
+    if (res <= 0) {
+      PLOG(ERROR) << "unable to read /dev/urandom";
+      ::close(fd);
+      return false;
+    }
+    buf += res;
+    len -= res;
+  }
+
+  ::close(fd);
+  return true;
+}
+
+// Bumped in the child after every fork, so generators can tell that they
+// were copied from the parent without calling getpid() each time.
+static std::atomic<unsigned int> forkGeneration(0);
+
+static void forkChild() { forkGeneration.fetch_add(1); }
+
+static bool registerForkHandler() {
+  int res = pthread_atfork(NULL, NULL, forkChild);
+  LOG_IF(ERROR, res != 0) << "unable to register fork handler: " << res;
+  return res == 0;
+}
+
+namespace {
+
+struct Generator {
+  byte key[KeyBytes];
+  byte buffer[BufferBytes];
+  int available;  // unused bytes at the end of buffer
+  uint64_t nonce;
+  long long produced;
+  bool seeded;
+  unsigned int generation;  // forkGeneration when seeded
+
+  Generator()
+      : available(0), nonce(0), produced(0), seeded(false), generation(0) {}
+
+  ~Generator() {
+    memset(key, 0, sizeof(key));
+    memset(buffer, 0, sizeof(buffer));
+  }
+
+  bool seed() {
+    byte seedBytes[KeyBytes + 8];
+    if (!readSystemRandom(seedBytes, sizeof(seedBytes))) return false;
+
+    memcpy(key, seedBytes, KeyBytes);
+    nonce = 0;
+    for (int i = 0; i < 8; ++i) nonce = (nonce << 8) | seedBytes[KeyBytes + i];
+    memset(seedBytes, 0, sizeof(seedBytes));
+
+    memset(buffer, 0, sizeof(buffer));
+    available = 0;
+    produced = 0;
+    seeded = true;
+    generation = forkGeneration.load(std::memory_order_relaxed);
+    return true;
+  }
+
+  void refill() {
+    // every refill uses a fresh key, so the counter restarts each time.
+    for (int i = 0; i < RefillBlocks; ++i)
+      FastRandom::chachaBlock(key, i, nonce, buffer + i * BlockBytes);
+
+    memcpy(key, buffer, KeyBytes);
+    memset(buffer, 0, KeyBytes);
+    available = BufferBytes - KeyBytes;
+  }
+
+  bool randomize(byte *out, int len) {
+    // a forked child must not repeat the parent's output.
+    if (!seeded ||
+        generation != forkGeneration.load(std::memory_order_relaxed) ||
+        produced >= FastRandom::ReseedBytes) {
+      if (!seed()) return false;
+    }
+
+    produced += len;
+    while (len > 0) {
+      if (available == 0) refill();
+
+      int toCopy = (len < available) ? len : available;
+      byte *src = buffer + BufferBytes - available;
+      memcpy(out, src, toCopy);
+      memset(src, 0, toCopy);
+
+      available -= toCopy;
+      out += toCopy;
+      len -= toCopy;
+    }
+    return true;
+  }
+};
+
+}  // namespace
+
+bool FastRandom::randomize(byte *buf, int len) {
+  static const bool forkHandler = registerForkHandler();
+  (void)forkHandler;
+  static thread_local Generator generator;
+  return generator.randomize(buf, len);
+}
+
+}  // namespace encfs
@@ -0,0 +1,57 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Random_incl_
+#define _Random_incl_
+
+#include "base/types.h"
+
+namespace encfs {
+
+/*
+    Fast pseudo random bytes, for values which need to be unpredictable but
+    are produced often, such as file IVs and random MAC bytes.
+
+    Each thread has its own ChaCha20 generator, seeded from the operating
+    system and refilled in bulk, so calls don't take a lock or make a system
+    call.  After each refill the generator rekeys from its own output, so
+    bytes already handed out can't be recovered from its state.  It reseeds
+    after a fork (noticed through a pthread_atfork handler, not getpid), and
+    after producing ReseedBytes.
+
+    Not for keys, which should use PBKDF::randomKey.
+*/
+class FastRandom {
+ public:
+  static const long long ReseedBytes = 1LL << 30;
+
+  // Fill buf with len random bytes.  Returns false if the generator can't be
+  // seeded, in which case buf is unchanged.
+  static bool randomize(byte *buf, int len);
+
+  // Produce one ChaCha20 block (64 bytes) from a 256 bit key, a 64 bit block
+  // counter and a 64 bit nonce.  Exposed for testing.
+  static void chachaBlock(const byte *key, unsigned long long counter,
+                          unsigned long long nonce, byte *out);
+};
+
+}  // namespace encfs
+
+#endif
@@ -0,0 +1,97 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "cipher/Random.h"
+#include "cipher/testing.h"
+
+using namespace encfs;
+
+namespace {
+
+TEST(FastRandomTest, ChaChaBlock) {
+  // Test vector from rfc7539 section 2.3.2.  The rfc uses a 32 bit counter
+  // and a 96 bit nonce, which map onto the 64 bit counter and nonce here.
+  byte key[32];
+  for (int i = 0; i < 32; ++i) key[i] = i;
+  byte out[64];
+  FastRandom::chachaBlock(key, 1 | (0x09000000ULL << 32), 0x4a000000, out);
+  ASSERT_EQ(
+      "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+      "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e",
+      stringToHex(out, 64));
+}
+
+TEST(FastRandomTest, Randomize) {
+  byte a[16], b[16];
+  ASSERT_TRUE(FastRandom::randomize(a, sizeof(a)));
+  ASSERT_TRUE(FastRandom::randomize(b, sizeof(b)));
+  ASSERT_NE(stringToHex(a, sizeof(a)), stringToHex(b, sizeof(b)));
+
+  // requests larger than one refill.
+  byte big[5000];
+  memset(big, 0, sizeof(big));
+  ASSERT_TRUE(FastRandom::randomize(big, sizeof(big)));
+  ASSERT_NE(stringToHex(big, 16), stringToHex(big + sizeof(big) - 16, 16));
+
+  // each thread has its own generator.
+  byte c[16];
+  std::thread t([&c] { FastRandom::randomize(c, sizeof(c)); });
+  t.join();
+  ASSERT_NE(stringToHex(a, sizeof(a)), stringToHex(c, sizeof(c)));
+}
+
+TEST(FastRandomTest, ReseedsAfterFork) {
+  byte seeded[16];
+  ASSERT_TRUE(FastRandom::randomize(seeded, sizeof(seeded)));
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  pid_t pid = fork();
+  ASSERT_LE(0, pid);
+  if (pid == 0) {
+    byte child[16];
+    bool ok = FastRandom::randomize(child, sizeof(child)) &&
+              write(fds[1], child, sizeof(child)) == sizeof(child);
+    _exit(ok ? 0 : 1);
+  }
+  close(fds[1]);
+
+  // without a reseed, the child would repeat the parent's next bytes.
+  byte parent[16], child[16];
+  ASSERT_TRUE(FastRandom::randomize(parent, sizeof(parent)));
+  ASSERT_EQ((ssize_t)sizeof(child), read(fds[0], child, sizeof(child)));
+  close(fds[0]);
+
+  int status = 0;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  ASSERT_NE(stringToHex(parent, sizeof(parent)),
+            stringToHex(child, sizeof(child)));
+}
+
+}  // namespace
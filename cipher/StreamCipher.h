@@ -31,6 +31,7 @@
 namespace encfs {
 
 static const char NAME_AES_CFB[] = "AES/CFB";
+static const char NAME_AES_CTR[] = "AES/CTR";
 static const char NAME_BLOWFISH_CFB[] = "Blowfish/CFB";
 
 class StreamCipher {
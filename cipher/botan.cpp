@@ -212,6 +212,25 @@ class BotanAesCfb : public BotanBlockCipher {
 };
 REGISTER_CLASS(BotanAesCfb, StreamCipher);
 
+class BotanAesCtr : public BotanBlockCipher {
+ public:
+  BotanAesCtr() {}
+  virtual ~BotanAesCtr() {}
+
+  virtual bool setKey(const CipherKey& key) {
+    std::ostringstream ss;
+    ss << "AES-" << (key.size() * 8) << "/CTR-BE";
+    return rekey(key, ss.str());
+  }
+
+  virtual int blockSize() const { return 128 >> 3; }
+
+  static Properties GetProperties() {
+    return Properties(Range(128, 256, 64), "AES", "CTR", "Botan");
+  }
+};
+REGISTER_CLASS(BotanAesCtr, StreamCipher);
+
 class BotanBlowfishCbc : public BotanBlockCipher {
  public:
   BotanBlowfishCbc() {}
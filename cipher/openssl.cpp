@@ -323,6 +323,41 @@ class AesCfbStreamCipher : public OpenSSLCipher {
   }
 };
 REGISTER_CLASS(AesCfbStreamCipher, StreamCipher);
+
+class AesCtrStreamCipher : public OpenSSLCipher {
+ public:
+  AesCtrStreamCipher() {}
+  virtual ~AesCtrStreamCipher() {}
+
+  virtual bool setKey(const CipherKey &key) {
+    const EVP_CIPHER *cipher = getCipher(key.size());
+    return (cipher != NULL) && rekey(cipher, key);
+  }
+
+  static const EVP_CIPHER *getCipher(int keyLength) {
+    switch (keyLength * 8) {
+      case 128:
+        return EVP_aes_128_ctr();
+      case 192:
+        return EVP_aes_192_ctr();
+      case 256:
+        return EVP_aes_256_ctr();
+      default:
+        LOG(INFO) << "Unsupported key length: " << keyLength;
+        return NULL;
+    }
+  }
+
+  static Properties GetProperties() {
+    Properties props;
+    props.keySize = AesKeyRange;
+    props.cipher = "AES";
+    props.mode = "CTR";
+    props.library = "OpenSSL";
+    return props;
+  }
+};
+REGISTER_CLASS(AesCtrStreamCipher, StreamCipher);
 #endif
 
 #if defined(HAVE_EVP_AES_XTS)
@@ -362,8 +397,14 @@ REGISTER_CLASS(AesXtsBlockCipher, BlockCipher);
 
 class Sha1HMac : public MAC {
  public:
-  Sha1HMac() { HMAC_CTX_init(&ctx); }
-  virtual ~Sha1HMac() { HMAC_CTX_cleanup(&ctx); }
+  Sha1HMac() {
+    HMAC_CTX_init(&ctx);
+    HMAC_CTX_init(&keyed);
+  }
+  virtual ~Sha1HMac() {
+    HMAC_CTX_cleanup(&ctx);
+    HMAC_CTX_cleanup(&keyed);
+  }
 
   virtual int outputSize() const {
     return 20;  // 160 bit.
@@ -371,6 +412,7 @@ class Sha1HMac : public MAC {
 
   virtual bool setKey(const CipherKey &key) {
     HMAC_Init_ex(&ctx, key.data(), key.size(), EVP_sha1(), 0);
+    HMAC_Init_ex(&keyed, key.data(), key.size(), EVP_sha1(), 0);
     return true;
   }
 
@@ -396,6 +438,25 @@ class Sha1HMac : public MAC {
     return true;
   }
 
+  // Each batch works on its own copy of the keyed context, and never
+  // touches ctx, so batches don't need the HMAC lock.
+  virtual bool computeBatch(const byte *const *in, const int *lengths,
+                            int count, byte *out) {
+    HMAC_CTX batch;
+    HMAC_CTX_init(&batch);
+    bool ok = HMAC_CTX_copy(&batch, &keyed);
+    for (int i = 0; ok && i < count; ++i) {
+      unsigned int outSize = 0;
+      ok = HMAC_Init_ex(&batch, 0, 0, 0, 0) &&
+           HMAC_Update(&batch, in[i], lengths[i]) &&
+           HMAC_Final(&batch, out + i * outputSize(), &outSize);
+    }
+    HMAC_CTX_cleanup(&batch);
+    return ok;
+  }
+
+  virtual bool concurrentBatch() const { return true; }
+
   static Properties GetProperties() {
     Properties props;
     props.blockSize = 20;
@@ -407,6 +468,7 @@ class Sha1HMac : public MAC {
 
  private:
   HMAC_CTX ctx;
+  HMAC_CTX keyed;  // only read once keyed, see computeBatch
 };
 REGISTER_CLASS(Sha1HMac, MAC);
 
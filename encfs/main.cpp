@@ -45,6 +45,7 @@
 #include "fs/FileUtils.h"
 #include "fs/DirNode.h"
 #include "fs/Context.h"
+#include "fs/Trash.h"
 
 #include <locale.h>
 
@@ -71,6 +72,7 @@ struct EncFS_Args {
   bool isThreaded;    // true == threaded
   bool isVerbose;     // false == only enable warning/error messages
   int idleTimeout;    // 0 == idle time in minutes to trigger unmount
+  string negativeTimeoutOpt;  // fuse option matching opts->negativeTimeout
   const char *fuseArgv[MaxFuseArgs];
   int fuseArgc;
 
@@ -93,6 +95,12 @@ struct EncFS_Args {
     if (opts->reverseEncryption) ss << "(reverseEncryption) ";
     if (opts->mountOnDemand) ss << "(mountOnDemand) ";
     if (opts->delayMount) ss << "(delayMount) ";
+    if (opts->dropBackingCache) ss << "(dropBackingCache) ";
+    if (opts->mmapRead) ss << "(mmapRead) ";
+    if (opts->writeLog) ss << "(writeLog) ";
+    if (opts->deferredDelete) ss << "(deferredDelete) ";
+    if (opts->negativeTimeout > 0)
+      ss << "(negativeTimeout " << opts->negativeTimeout << ") ";
     for (int i = 0; i < fuseArgc; ++i) ss << fuseArgv[i] << ' ';
 
     return ss.str();
@@ -147,6 +155,16 @@ static void usage(const char *name) {
             "act as a typical multi-user filesystem\n"
             "\t\t\t(encfs must be run as root)\n") << _("  --reverse\t\t"
                                                         "reverse encryption\n")
+       << _("  --drop-backing-cache\t"
+            "don't keep encrypted data in the page cache\n")
+       << _("  --mmap-read\t\t"
+            "read encrypted files through memory mappings\n")
+       << _("  --write-log\t\t"
+            "merge random writes in memory until close or fsync\n")
+       << _("  --deferred-delete\t"
+            "free the space of deleted files in the background\n")
+       << _("  --negative-timeout=SECONDS\n"
+            "\t\t\tremember missing paths for SECONDS\n")
 
       // xgroup(usage)
        << _("  --extpass=program\tUse external program for password prompt\n"
@@ -228,6 +246,11 @@ static bool processArgs(int argc, char *argv[],
       {"reverse", 0, 0, 'r'},   // reverse encryption
       {"standard", 0, 0, '1'},  // standard configuration
       {"paranoia", 0, 0, '2'},  // standard configuration
+      {"drop-backing-cache", 0, 0, 515},  // don't cache ciphertext
+      {"mmap-read", 0, 0, 516},           // read through memory mappings
+      {"write-log", 0, 0, 517},           // buffer written blocks
+      {"deferred-delete", 0, 0, 518},     // unlink through the trash
+      {"negative-timeout", 1, 0, 519},    // cache missing paths
       {0, 0, 0, 0}};
 
   while (1) {
@@ -262,6 +285,21 @@ static bool processArgs(int argc, char *argv[],
       case 513:
         out->opts->annotate = true;
         break;
+      case 515:
+        out->opts->dropBackingCache = true;
+        break;
+      case 516:
+        out->opts->mmapRead = true;
+        break;
+      case 517:
+        out->opts->writeLog = true;
+        break;
+      case 518:
+        out->opts->deferredDelete = true;
+        break;
+      case 519:
+        out->opts->negativeTimeout = strtol(optarg, (char **)NULL, 10);
+        break;
       case 'f':
         out->isDaemon = false;
         // this option was added in fuse 2.x
@@ -336,6 +374,15 @@ static bool processArgs(int argc, char *argv[],
 
   if (!out->isThreaded) PUSHARG("-s");
 
+  // let the kernel keep negative entries for as long as we do.
+  if (out->opts->negativeTimeout > 0) {
+    ostringstream ss;
+    ss << "negative_timeout=" << out->opts->negativeTimeout;
+    out->negativeTimeoutOpt = ss.str();
+    PUSHARG("-o");
+    PUSHARG(out->negativeTimeoutOpt.c_str());
+  }
+
   if (useDefaultFlags) {
     PUSHARG("-o");
     PUSHARG("use_ino");
@@ -432,6 +479,13 @@ void *encfs_init(fuse_conn_info *conn) {
   // set fuse connection options
   conn->async_read = true;
 
+#ifdef FUSE_CAP_ATOMIC_O_TRUNC
+  // have O_TRUNC passed to open, so DirNode::openNode truncates under the
+  // node lock, rather than the kernel sending a separate setattr.
+  if (conn->capable & FUSE_CAP_ATOMIC_O_TRUNC)
+    conn->want |= FUSE_CAP_ATOMIC_O_TRUNC;
+#endif
+
   // if an idle timeout is specified, then setup a thread to monitor the
   // filesystem.
   if (ctx->args->idleTimeout > 0) {
@@ -445,6 +499,10 @@ void *encfs_init(fuse_conn_info *conn) {
     }
   }
 
+  // started here rather than in main, since threads don't survive the fork
+  // into the background.
+  if (ctx->trash) ctx->trash->start();
+
   if (ctx->args->isDaemon && oldStderr >= 0) {
     VLOG(1) << "Closing stderr";
     close(oldStderr);
@@ -456,6 +514,8 @@ void *encfs_init(fuse_conn_info *conn) {
 
 void encfs_destroy(void *_ctx) {
   EncFS_Context *ctx = static_cast<EncFS_Context *>(_ctx);
+  if (ctx->trash) ctx->trash->stop();
+
   if (ctx->args->idleTimeout > 0) {
     ctx->running = false;
 
@@ -556,6 +616,9 @@ int main(int argc, char *argv[]) {
   encfs_oper.fgetattr = encfs_fgetattr;
   // encfs_oper.lock = encfs_lock;
   encfs_oper.utimens = encfs_utimens;
+#if FUSE_VERSION >= 29
+  encfs_oper.fallocate = encfs_fallocate;
+#endif
 // encfs_oper.bmap = encfs_bmap;
 
 #if (__FreeBSD__ >= 10)
@@ -590,6 +653,15 @@ int main(int argc, char *argv[]) {
     ctx->args = encfsArgs;
     ctx->opts = encfsArgs->opts;
 
+    // free whatever was left in the trash by an earlier mount.  With
+    // deferred deletion the reaper thread does this in the background.
+    if (!encfsArgs->opts->reverseEncryption) {
+      if (encfsArgs->opts->deferredDelete)
+        ctx->trash.reset(new Trash(encfsArgs->opts->rootDir));
+      else
+        Trash::purge(encfsArgs->opts->rootDir);
+    }
+
     if (encfsArgs->isThreaded == false && encfsArgs->idleTimeout > 0) {
       // xgroup(usage)
       cerr << _("Note: requested single-threaded mode, but an idle\n"
@@ -92,6 +92,10 @@ bool BlockFileIO::cacheWriteOneBlock(const IORequest &req) {
   return ok;
 }
 
+void BlockFileIO::invalidateCache() {
+  if (_cache.dataLen > 0) clearCache(_cache, _blockSize);
+}
+
 ssize_t BlockFileIO::read(const IORequest &req) const {
   rAssert(_blockSize != 0);
 
@@ -117,6 +121,25 @@ ssize_t BlockFileIO::read(const IORequest &req) const {
     while (size) {
       blockReq.offset = blockNum * _blockSize;
 
+      // runs of whole blocks are read directly into the result buffer, all
+      // at once.
+      if (partialOffset == 0 && size >= 2 * (size_t)_blockSize) {
+        blockReq.data = out;
+        blockReq.dataLen = (size / _blockSize) * _blockSize;
+
+        ssize_t readSize = readBlocks(blockReq);
+        if (readSize <= 0) break;
+
+        result += readSize;
+        size -= readSize;
+        out += readSize;
+        blockNum += readSize / _blockSize;
+
+        if (readSize < blockReq.dataLen) break;
+        blockReq.dataLen = _blockSize;
+        continue;
+      }
+
       // if we're reading a full block, then read directly into the
       // result buffer instead of using a temporary
       if (partialOffset == 0 && size >= (size_t)_blockSize)
@@ -295,14 +318,14 @@ void BlockFileIO::padFile(off_t oldSize, off_t newSize, bool forceWrite) {
     }
 
     // 2, pad zero blocks unless holes are allowed
-    if (!_allowHoles) {
-      for (; oldLastBlock != newLastBlock; ++oldLastBlock) {
-        VLOG(1) << "padding block " << oldLastBlock;
-        req.offset = oldLastBlock * _blockSize;
-        req.dataLen = _blockSize;
-        memset(mb.data, 0, req.dataLen);
-        cacheWriteOneBlock(req);
-      }
+    if (!_allowHoles && oldLastBlock != newLastBlock) {
+      VLOG(1) << "padding blocks " << oldLastBlock << " to " << newLastBlock;
+      // blocks are written behind the cache's back..
+      if (_cache.dataLen > 0 && _cache.offset >= oldLastBlock * _blockSize)
+        clearCache(_cache, _blockSize);
+      if (!writeZeroBlocks(oldLastBlock, newLastBlock - oldLastBlock))
+        LOG(ERROR) << "failed to pad blocks " << oldLastBlock << " to "
+                   << newLastBlock;
     }
 
     // 3. only necessary if write is forced and block is non 0 length
@@ -315,6 +338,44 @@ void BlockFileIO::padFile(off_t oldSize, off_t newSize, bool forceWrite) {
   }
 }
 
+ssize_t BlockFileIO::readBlocks(const IORequest &req) const {
+  IORequest blockReq;
+  blockReq.offset = req.offset;
+  blockReq.data = req.data;
+  blockReq.dataLen = _blockSize;
+
+  ssize_t result = 0;
+  while (result < req.dataLen) {
+    ssize_t readSize = cacheReadOneBlock(blockReq);
+    if (readSize <= 0) break;
+
+    result += readSize;
+    if (readSize < _blockSize) break;
+
+    blockReq.offset += _blockSize;
+    blockReq.data += _blockSize;
+  }
+
+  return result;
+}
+
+bool BlockFileIO::writeZeroBlocks(off_t blockNum, off_t count) {
+  MemBlock mb;
+  mb.allocate(_blockSize);
+
+  IORequest req;
+  req.data = mb.data;
+  req.dataLen = _blockSize;
+
+  for (; count > 0; --count, ++blockNum) {
+    req.offset = blockNum * _blockSize;
+    memset(mb.data, 0, _blockSize);
+    if (!writeOneBlock(req)) return false;
+  }
+
+  return true;
+}
+
 int BlockFileIO::blockTruncate(off_t size, FileIO *base) {
   rAssert(size >= 0);
 
@@ -362,8 +423,12 @@ int BlockFileIO::blockTruncate(off_t size, FileIO *base) {
     }
 
   } else {
-    // truncating on a block bounday.  No need to re-encode the last
-    // block..
+    // truncating on a block bounday (which includes truncate-to-zero).  No
+    // need to read or re-encode anything, just drop any cached block which
+    // is no longer part of the file..
+    if (_cache.dataLen > 0 && _cache.offset >= size)
+      clearCache(_cache, _blockSize);
+
     if (base) res = base->truncate(size);
   }
 
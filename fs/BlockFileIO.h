@@ -49,14 +49,26 @@ class BlockFileIO : public FileIO {
   int blockTruncate(off_t size, FileIO *base);
   void padFile(off_t oldSize, off_t newSize, bool forceWrite);
 
+  // Write count blocks of zeros starting at blockNum.  The default writes
+  // them one at a time, derived classes may batch the writes.
+  virtual bool writeZeroBlocks(off_t blockNum, off_t count);
+
   // same as read(), except that the request.offset field is guarenteed to be
   // block aligned, and the request size will not be larger then 1 block.
   virtual ssize_t readOneBlock(const IORequest &req) const = 0;
   virtual bool writeOneBlock(const IORequest &req) = 0;
 
+  // Read a run of whole blocks, with a block aligned request.  Returns the
+  // amount read, which is only short at the end of the file.  The default
+  // reads them one at a time, derived classes may batch the reads.
+  virtual ssize_t readBlocks(const IORequest &req) const;
+
   ssize_t cacheReadOneBlock(const IORequest &req) const;
   bool cacheWriteOneBlock(const IORequest &req);
 
+  // drop the cached block, for when data is changed underneath us.
+  void invalidateCache();
+
   int _blockSize;
   bool _allowHoles;
 
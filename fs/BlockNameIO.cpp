@@ -26,14 +26,12 @@
 #include "cipher/CipherV1.h"
 
 #include <cstring>
-#include <vector>
 
 #include <glog/logging.h>
 
 namespace encfs {
 
 using std::string;
-using std::vector;
 
 static shared_ptr<NameIO> NewBlockNameIO(const Interface &iface,
                                          const shared_ptr<CipherV1> &cipher) {
@@ -120,65 +118,90 @@ int BlockNameIO::maxDecodedNameLen(int encodedNameLen) const {
 
 string BlockNameIO::encodeName(const string &plaintextName,
                                uint64_t *iv) const {
-  int length = plaintextName.length();
+  string result;
+  appendEncodedName(plaintextName.data(), plaintextName.length(), iv, &result);
+  return result;
+}
+
+void BlockNameIO::appendEncodedName(const char *plaintextName, int length,
+                                    uint64_t *iv, string *output) const {
   // Pad encryption buffer to block boundary..
   int padding = _bs - length % _bs;
   int encodedStreamLen = length + 2 + padding;
   int encLen = _caseSensitive ? B256ToB32Bytes(encodedStreamLen)
                               : B256ToB64Bytes(encodedStreamLen);
 
-  vector<byte> tmpBuf(encLen);
+  // encode in place, at the end of the output.
+  size_t start = output->size();
+  output->resize(start + encLen);
+  byte *tmpBuf = reinterpret_cast<byte *>(&(*output)[start]);
 
   // copy the data into the encoding buffer..
-  memcpy(tmpBuf.data() + 2, plaintextName.data(), length);
-  memset(tmpBuf.data() + length + 2, (unsigned char)padding, padding);
+  memcpy(tmpBuf + 2, plaintextName, length);
+  memset(tmpBuf + length + 2, (unsigned char)padding, padding);
 
   // store the IV before it is modified by the MAC call.
   uint64_t tmpIV = 0;
   if (iv && _interface >= 3) tmpIV = *iv;
 
   // include padding in MAC computation
-  unsigned int mac = _cipher->reduceMac16(
-      _cipher->MAC_64(tmpBuf.data() + 2, length + padding, iv));
+  unsigned int mac =
+      _cipher->reduceMac16(_cipher->MAC_64(tmpBuf + 2, length + padding, iv));
   tmpIV ^= (uint64_t)mac;
 
   // add checksum bytes
   tmpBuf[0] = (mac >> 8) & 0xff;
   tmpBuf[1] = (mac) & 0xff;
 
-  _cipher->blockEncode(tmpBuf.data() + 2, length + padding, tmpIV);
+  _cipher->blockEncode(tmpBuf + 2, length + padding, tmpIV);
 
   // convert to base 32 or 64 ascii
   if (_caseSensitive) {
-    changeBase2Inline(tmpBuf.data(), encodedStreamLen, 8, 5, true);
-    B32ToAscii(tmpBuf.data(), encLen);
+    changeBase2Inline(tmpBuf, encodedStreamLen, 8, 5, true);
+    B32ToAscii(tmpBuf, encLen);
   } else {
-    changeBase2Inline(tmpBuf.data(), encodedStreamLen, 8, 6, true);
-    B64ToAscii(tmpBuf.data(), encLen);
+    changeBase2Inline(tmpBuf, encodedStreamLen, 8, 6, true);
+    B64ToAscii(tmpBuf, encLen);
   }
-
-  return string(reinterpret_cast<char*>(tmpBuf.data()), encLen);
 }
 
 string BlockNameIO::decodeName(const string &encodedName, uint64_t *iv) const {
-  int length = encodedName.length();
+  string result;
+  if (!tryDecodeName(encodedName, iv, &result))
+    throw Error("Invalid encoded filename");
+  return result;
+}
+
+bool BlockNameIO::tryDecodeName(const string &encodedName, uint64_t *iv,
+                                string *result) const {
+  result->clear();
+  return appendDecodedName(encodedName.data(), encodedName.length(), iv,
+                           result);
+}
+
+bool BlockNameIO::appendDecodedName(const char *encodedName, int length,
+                                    uint64_t *iv, string *output) const {
   int decLen256 =
       _caseSensitive ? B32ToB256Bytes(length) : B64ToB256Bytes(length);
   int decodedStreamLen = decLen256 - 2;
 
   // don't bother trying to decode files which are too small
-  if (decodedStreamLen < _bs) throw Error("Filename too small to decode");
+  if (decodedStreamLen < _bs) {
+    VLOG(1) << "filename too small to decode";
+    return false;
+  }
 
-  vector<byte> tmpBuf(length, 0);
-  memcpy(tmpBuf.data(), encodedName.data(), length);
+  // decode in place, at the end of the output.
+  size_t start = output->size();
+  output->append(encodedName, length);
+  byte *tmpBuf = reinterpret_cast<byte *>(&(*output)[start]);
 
-  // decode into tmpBuf,
   if (_caseSensitive) {
-    AsciiToB32(tmpBuf.data(), length);
-    changeBase2Inline(tmpBuf.data(), length, 5, 8, false);
+    AsciiToB32(tmpBuf, length);
+    changeBase2Inline(tmpBuf, length, 5, 8, false);
   } else {
-    AsciiToB64(tmpBuf.data(), length);
-    changeBase2Inline(tmpBuf.data(), length, 6, 8, false);
+    AsciiToB64(tmpBuf, length);
+    changeBase2Inline(tmpBuf, length, 6, 8, false);
   }
 
   // pull out the header information
@@ -189,7 +212,7 @@ string BlockNameIO::decodeName(const string &encodedName, uint64_t *iv) const {
   if (iv && _interface >= 3) tmpIV = *iv;
   tmpIV ^= (uint64_t)mac;
 
-  _cipher->blockDecode(&tmpBuf.at(2), decodedStreamLen, tmpIV);
+  _cipher->blockDecode(tmpBuf + 2, decodedStreamLen, tmpIV);
 
   // find out true string length
   int padding = tmpBuf[2 + decodedStreamLen - 1];
@@ -199,20 +222,24 @@ string BlockNameIO::decodeName(const string &encodedName, uint64_t *iv) const {
   if (padding > _bs || finalSize < 0) {
     VLOG(1) << "padding, _bx, finalSize = " << padding << ", " << _bs << ", "
             << finalSize;
-    throw Error("invalid padding size");
+    output->resize(start);
+    return false;
   }
 
   // check the mac
-  unsigned int mac2 = _cipher->reduceMac16(
-      _cipher->MAC_64(&tmpBuf.at(2), decodedStreamLen, iv));
+  unsigned int mac2 =
+      _cipher->reduceMac16(_cipher->MAC_64(tmpBuf + 2, decodedStreamLen, iv));
 
   if (mac2 != mac) {
-    LOG(INFO) << "checksum mismatch: expected " << mac << ", got " << mac2
-              << " on decode of " << finalSize << " bytes";
-    throw Error("checksum mismatch in filename decode");
+    VLOG(1) << "checksum mismatch: expected " << mac << ", got " << mac2
+            << " on decode of " << finalSize << " bytes";
+    output->resize(start);
+    return false;
   }
 
-  return string(reinterpret_cast<char*>(&tmpBuf.at(2)), finalSize);
+  memmove(tmpBuf, tmpBuf + 2, finalSize);
+  output->resize(start + finalSize);
+  return true;
 }
 
 bool BlockNameIO::Enabled() { return true; }
@@ -0,0 +1,227 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/config.h"
+#include "fs/ChangeRecord.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef HAVE_ATTR_XATTR_H
+#include <attr/xattr.h>
+#elif defined(HAVE_SYS_XATTR_H)
+#include <sys/xattr.h>
+#endif
+
+namespace encfs {
+
+const char ChangeRecordAttribute[] = "user.encfs.changes";
+
+// Stored format: version byte, shift byte, 8 byte little endian generation,
+// then the bitmap.
+static const int RecordVersion = 1;
+static const int HeaderBytes = 10;
+
+// Smallest unit tracked, and the bitmap size at which bits are combined.
+// Together they cover a 1 GiB file at full detail, and the record stays small
+// enough for filesystems which limit attributes to one block.
+static const int MinShift = 16;
+static const size_t MaxBitmapBytes = 2048;
+
+ChangeRecord::ChangeRecord() : generation(0), shift(MinShift) {}
+
+bool ChangeRecord::empty() const {
+  for (size_t i = 0; i < bits.size(); ++i)
+    if (bits[i]) return false;
+  return true;
+}
+
+void ChangeRecord::clear() { bits.clear(); }
+
+void ChangeRecord::mark(off_t offset, off_t length) {
+  if (length <= 0) return;
+
+  // combine bits first, so the bitmap never grows past its limit.
+  off_t end = offset + length - 1;
+  int newShift = shift;
+  while ((size_t)((end >> newShift) / 8) >= MaxBitmapBytes) ++newShift;
+  coarsen(newShift);
+
+  off_t first = offset >> shift;
+  off_t last = end >> shift;
+  if ((size_t)(last / 8) >= bits.size()) bits.resize(last / 8 + 1, 0);
+
+  // partial bytes at either end, and whole bytes in between.
+  off_t bit = first;
+  for (; bit <= last && bit % 8; ++bit) bits[bit / 8] |= 1 << (bit % 8);
+  if (bit + 8 <= last + 1) {
+    memset(&bits[bit / 8], 0xff, (last + 1) / 8 - bit / 8);
+    bit = (last + 1) / 8 * 8;
+  }
+  for (; bit <= last; ++bit) bits[bit / 8] |= 1 << (bit % 8);
+}
+
+bool ChangeRecord::covers(off_t offset, off_t length) const {
+  if (length <= 0) return true;
+
+  off_t last = (offset + length - 1) >> shift;
+  if ((size_t)(last / 8) >= bits.size()) return false;
+  for (off_t bit = offset >> shift; bit <= last; ++bit)
+    if (!(bits[bit / 8] & (1 << (bit % 8)))) return false;
+  return true;
+}
+
+void ChangeRecord::coarsen(int newShift) {
+  while (shift < newShift) {
+    std::vector<unsigned char> half((bits.size() + 1) / 2, 0);
+    for (size_t bit = 0; bit < bits.size() * 8; ++bit)
+      if (bits[bit / 8] & (1 << (bit % 8)))
+        half[bit / 16] |= 1 << ((bit / 2) % 8);
+    bits.swap(half);
+    ++shift;
+  }
+}
+
+void ChangeRecord::merge(const ChangeRecord &other) {
+  ChangeRecord tmp = other;
+  if (tmp.shift < shift)
+    tmp.coarsen(shift);
+  else
+    coarsen(tmp.shift);
+
+  if (tmp.bits.size() > bits.size()) bits.resize(tmp.bits.size(), 0);
+  for (size_t i = 0; i < tmp.bits.size(); ++i) bits[i] |= tmp.bits[i];
+
+  while (bits.size() > MaxBitmapBytes) coarsen(shift + 1);
+}
+
+void ChangeRecord::unmark(const ChangeRecord &other, off_t size) {
+  off_t unit = (off_t)1 << shift;
+  for (size_t bit = 0; bit < bits.size() * 8; ++bit) {
+    if ((off_t)bit * unit >= size) break;
+    if (other.covers(bit * unit, unit)) bits[bit / 8] &= ~(1 << (bit % 8));
+  }
+}
+
+std::vector<std::pair<off_t, off_t> > ChangeRecord::ranges(off_t size) const {
+  std::vector<std::pair<off_t, off_t> > result;
+  off_t unit = (off_t)1 << shift;
+
+  for (size_t bit = 0; bit < bits.size() * 8; ++bit) {
+    if (!(bits[bit / 8] & (1 << (bit % 8)))) continue;
+
+    off_t start = bit * unit;
+    if (start >= size) break;
+    off_t end = start + unit;
+    if (end > size) end = size;
+
+    if (!result.empty() && result.back().second == start)
+      result.back().second = end;
+    else
+      result.push_back(std::make_pair(start, end));
+  }
+
+  return result;
+}
+
+std::string ChangeRecord::encode() const {
+  std::string data(HeaderBytes, '\0');
+  data[0] = RecordVersion;
+  data[1] = shift;
+  uint64_t value = generation;
+  for (int i = 0; i < 8; ++i) {
+    data[2 + i] = value & 0xff;
+    value >>= 8;
+  }
+
+  data.append(bits.begin(), bits.end());
+  return data;
+}
+
+bool ChangeRecord::decode(const std::string &data) {
+  if (data.size() < (size_t)HeaderBytes || data[0] != RecordVersion)
+    return false;
+
+  int newShift = (unsigned char)data[1];
+  if (newShift < MinShift || newShift > 62) return false;
+
+  shift = newShift;
+  generation = 0;
+  for (int i = 7; i >= 0; --i)
+    generation = (generation << 8) | (unsigned char)data[2 + i];
+  bits.assign(data.begin() + HeaderBytes, data.end());
+  return true;
+}
+
+int readChangeRecord(int fd, const char *path, ChangeRecord *record) {
+#if defined(HAVE_ATTR_XATTR_H) || defined(HAVE_SYS_XATTR_H)
+  std::string data(HeaderBytes + MaxBitmapBytes, '\0');
+#ifdef XATTR_ADD_OPT
+  ssize_t res = (fd >= 0) ? ::fgetxattr(fd, ChangeRecordAttribute, &data[0],
+                                        data.size(), 0, 0)
+                          : ::getxattr(path, ChangeRecordAttribute, &data[0],
+                                       data.size(), 0, XATTR_NOFOLLOW);
+#else
+  ssize_t res = (fd >= 0) ? ::fgetxattr(fd, ChangeRecordAttribute, &data[0],
+                                        data.size())
+                          : ::lgetxattr(path, ChangeRecordAttribute, &data[0],
+                                        data.size());
+#endif
+  if (res < 0) {
+#ifdef ENOATTR
+    if (errno == ENOATTR) return -ENODATA;
+#endif
+    return -errno;
+  }
+
+  data.resize(res);
+  return record->decode(data) ? 0 : -EINVAL;
+#else
+  (void)fd;
+  (void)path;
+  (void)record;
+  return -ENOTSUP;
+#endif
+}
+
+int writeChangeRecord(int fd, const char *path, const ChangeRecord &record) {
+#if defined(HAVE_ATTR_XATTR_H) || defined(HAVE_SYS_XATTR_H)
+  std::string data = record.encode();
+#ifdef XATTR_ADD_OPT
+  int res = (fd >= 0) ? ::fsetxattr(fd, ChangeRecordAttribute, data.data(),
+                                    data.size(), 0, 0)
+                      : ::setxattr(path, ChangeRecordAttribute, data.data(),
+                                   data.size(), 0, XATTR_NOFOLLOW);
+#else
+  int res = (fd >= 0) ? ::fsetxattr(fd, ChangeRecordAttribute, data.data(),
+                                    data.size(), 0)
+                      : ::lsetxattr(path, ChangeRecordAttribute, data.data(),
+                                    data.size(), 0);
+#endif
+  return (res < 0) ? -errno : 0;
+#else
+  (void)fd;
+  (void)path;
+  (void)record;
+  return -ENOTSUP;
+#endif
+}
+
+}  // namespace encfs
@@ -0,0 +1,86 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ChangeRecord_incl_
+#define _ChangeRecord_incl_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace encfs {
+
+// Extended attribute which holds the change record of a backing file.
+extern const char ChangeRecordAttribute[];
+
+/*
+    Record of which parts of a backing (encrypted) file have changed since a
+    backup tool last reset it, kept in an extended attribute of the file.
+
+    Each bit covers 2^shift bytes of the backing file.  When a file grows
+    beyond what the stored bitmap can cover, neighbouring bits are combined,
+    so large files are tracked with a coarser granularity.  The generation is
+    incremented every time the record is reset, so a backup tool can tell
+    whether the record continues from its last snapshot.
+*/
+struct ChangeRecord {
+  uint64_t generation;
+  int shift;
+  std::vector<unsigned char> bits;
+
+  ChangeRecord();
+
+  bool empty() const;
+  void clear();
+
+  // mark a range of the backing file as changed.
+  void mark(off_t offset, off_t length);
+
+  // true if every unit of the range is marked.
+  bool covers(off_t offset, off_t length) const;
+
+  // add the changes from another record, keeping this generation.
+  void merge(const ChangeRecord &other);
+
+  // clear the units which start below size and are wholly marked in other.
+  void unmark(const ChangeRecord &other, off_t size);
+
+  // changed ranges as [start, end) byte offsets, limited to size.
+  std::vector<std::pair<off_t, off_t> > ranges(off_t size) const;
+
+  std::string encode() const;
+  bool decode(const std::string &data);
+
+ private:
+  void coarsen(int newShift);
+};
+
+// Read or write the record of a backing file, using fd if it is >= 0, or
+// path otherwise.  Return 0 on success, -errno on failure.  Reading a file
+// without a record returns -ENODATA.
+int readChangeRecord(int fd, const char *path, ChangeRecord *record);
+int writeChangeRecord(int fd, const char *path, const ChangeRecord &record);
+
+}  // namespace encfs
+
+#endif
@@ -29,6 +29,7 @@
 
 #include <fcntl.h>
 #include <cerrno>
+#include <cstring>
 
 namespace encfs {
 
@@ -37,9 +38,16 @@ namespace encfs {
    fixed 8 byte header.  The headers are enabled globally within a
    filesystem at the filesystem configuration level.
    When headers are disabled, 2:0 is compatible with version 1:0.
+
+   The header may be padded with zeros (header_align in the filesystem
+   configuration), so that the encrypted blocks start on a page boundary.
 */
 static Interface CipherFileIO_iface = makeInterface("FileIO/Cipher", 3, 0, 2);
 
+// Zero padding is encoded in batches of up to this many bytes, so that a
+// large extension turns into a few large writes.
+static const int PadBatchSize = 1024 * 1024;
+
 CipherFileIO::CipherFileIO(const shared_ptr<FileIO> &_base,
                            const FSConfigPtr &cfg)
     : BlockFileIO(cfg->config->block_size(), cfg),
@@ -52,7 +60,14 @@ CipherFileIO::CipherFileIO(const shared_ptr<FileIO> &_base,
   fsConfig = cfg;
   cipher = cfg->cipher;
 
-  if (perFileIV) headerLen += sizeof(uint64_t);  // 64bit IV per file
+  if (perFileIV) {
+    headerLen += sizeof(uint64_t);  // 64bit IV per file
+
+    // pad the header, so that encrypted blocks line up with pages of the
+    // backing filesystem.
+    int align = cfg->config->header_align();
+    if (align > headerLen) headerLen = align;
+  }
 
   int blockBoundary =
       fsConfig->config->block_size() % fsConfig->cipher->cipherBlockSize();
@@ -148,7 +163,7 @@ void CipherFileIO::initHeader() {
   int cbs = cipher->cipherBlockSize();
 
   MemBlock mb;
-  mb.allocate(cbs);
+  mb.allocate(headerLen > cbs ? headerLen : cbs);
 
   // check if the file has a header, and read it if it does..  Otherwise,
   // create one.
@@ -187,12 +202,13 @@ void CipherFileIO::initHeader() {
     } while (fileIV == 0);  // don't accept 0 as an option..
 
     cipher->streamEncode(mb.data, sizeof(uint64_t), externalIV);
+    memset(mb.data + sizeof(uint64_t), 0, headerLen - sizeof(uint64_t));
 
     if (base->isWritable()) {
       IORequest req;
       req.offset = 0;
       req.data = mb.data;
-      req.dataLen = sizeof(uint64_t);
+      req.dataLen = headerLen;
 
       base->write(req);
     } else
@@ -216,6 +232,7 @@ bool CipherFileIO::writeHeader() {
 
   MemBlock mb;
   mb.allocate(headerLen);
+  memset(mb.data, 0, headerLen);
 
   if (perFileIV) {
     unsigned char *buf = mb.data;
@@ -319,6 +336,41 @@ bool CipherFileIO::writeOneBlock(const IORequest &req) {
   return ok;
 }
 
+bool CipherFileIO::writeZeroBlocks(off_t blockNum, off_t count) {
+  int bs = blockSize();
+  if (headerLen != 0 && fileIV == 0) initHeader();
+
+  off_t batch = PadBatchSize / bs;
+  if (batch < 1) batch = 1;
+  if (batch > count) batch = count;
+
+  MemBlock mb;
+  mb.allocate(batch * bs);
+
+  while (count > 0) {
+    int n = (count < batch) ? count : batch;
+    memset(mb.data, 0, n * bs);
+
+    for (int i = 0; i < n; ++i) {
+      if (!blockWrite(mb.data + i * bs, bs, (blockNum + i) ^ fileIV)) {
+        VLOG(1) << "encodeBlock failed for block " << blockNum + i;
+        return false;
+      }
+    }
+
+    IORequest req;
+    req.offset = blockNum * bs + headerLen;
+    req.data = mb.data;
+    req.dataLen = n * bs;
+    if (!base->write(req)) return false;
+
+    blockNum += n;
+    count -= n;
+  }
+
+  return true;
+}
+
 bool CipherFileIO::blockWrite(unsigned char *buf, int size,
                               uint64_t _iv64) const {
   if (!fsConfig->reverseEncryption)
@@ -362,7 +414,26 @@ int CipherFileIO::truncate(off_t size) {
 
   if (headerLen == 0) {
     return blockTruncate(size, base.get());
-  } else if (0 == fileIV) {
+  }
+
+  // Shrinking to a block boundary (including truncate-to-zero) never needs
+  // to re-encode a block, so the file IV is not needed either.  Keep any
+  // existing header as-is rather than reading and rewriting it.
+  off_t rawSize = base->getSize();
+  if (size == 0 || (size < adjustedSize(rawSize) && size % blockSize() == 0)) {
+    int res = blockTruncate(size, 0);
+    if (res == 0) {
+      if (rawSize >= headerLen) {
+        res = base->truncate(size + headerLen);
+      } else {
+        res = base->truncate(0);
+        fileIV = 0;  // no header on disk, create a new one on next write.
+      }
+    }
+    return res;
+  }
+
+  if (0 == fileIV) {
     // empty file.. create the header..
     if (!base->isWritable()) {
       // open for write..
@@ -382,6 +453,32 @@ int CipherFileIO::truncate(off_t size) {
   return res;
 }
 
+int CipherFileIO::allocate(off_t offset, off_t length) {
+  rAssert(offset >= 0 && length >= 0);
+
+  // Extend first, so the zero blocks are encoded against the old file end,
+  // then let the backing file reserve whatever holes are left.
+  int res = 0;
+  if (offset + length > getSize()) res = truncate(offset + length);
+
+  if (res == 0) res = base->allocate(offset + headerLen, length);
+
+  return res;
+}
+
+int CipherFileIO::punchHole(off_t offset, off_t length) {
+  // only whole blocks can be dropped, partial blocks are left alone.
+  int bs = blockSize();
+  off_t start = ((offset + bs - 1) / bs) * bs;
+  off_t end = ((offset + length) / bs) * bs;
+  if (end <= start) return 0;
+
+  invalidateCache();
+  return base->punchHole(start + headerLen, end - start);
+}
+
+int CipherFileIO::flush() { return base->flush(); }
+
 bool CipherFileIO::isWritable() const { return base->isWritable(); }
 
 }  // namespace encfs
@@ -56,12 +56,16 @@ class CipherFileIO : public BlockFileIO {
   // not 0.  The extended ciphertext may be 0, resulting in non-zero
   // plaintext.
   virtual int truncate(off_t size);
+  virtual int allocate(off_t offset, off_t length);
+  virtual int punchHole(off_t offset, off_t length);
+  virtual int flush();
 
   virtual bool isWritable() const;
 
  private:
   virtual ssize_t readOneBlock(const IORequest &req) const;
   virtual bool writeOneBlock(const IORequest &req);
+  virtual bool writeZeroBlocks(off_t blockNum, off_t count);
 
   void initHeader();
   bool writeHeader();
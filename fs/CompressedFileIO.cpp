@@ -0,0 +1,404 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fs/CompressedFileIO.h"
+#include "fs/fsconfig.pb.h"
+
+#include "base/config.h"
+#include "base/Error.h"
+#include "cipher/MemoryPool.h"
+
+#include <glog/logging.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace encfs {
+
+//
+// Layout of the next layer:
+//
+//   [index 0] [slot 0] ... [slot k-1] [index 1] [slot k] ...
+//
+// Index blocks are blockSize bytes, holding k = blockSize / 4 little endian
+// 32 bit lengths.  Slots are ChunkBlocks * blockSize bytes.  A length of 0
+// means the chunk is stored as-is, otherwise it is the size of the
+// compressed data at the start of the slot, which is written padded to whole
+// blocks.
+//
+// A slot and its index entry can't be written atomically.  When a chunk
+// changes from or to compressed, its entry is first set to ChunkChanging and
+// synced, then the slot is written and synced, and then the entry gets its new
+// value.  After a crash in between, reads of the chunk fail with EIO instead
+// of returning data decoded the wrong way.
+//
+static Interface CompressedFileIO_iface =
+    makeInterface("FileIO/Compressed", 1, 0, 0);
+
+// Chunk size, in blocks of the next layer.  Larger chunks compress better,
+// but every partial write to a compressed chunk rewrites the whole chunk.
+static const int ChunkBlocks = 32;
+
+// Index entry of a chunk whose slot is being rewritten.
+static const uint32_t ChunkChanging = 0xffffffff;
+
+static void putU32(unsigned char *buf, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    buf[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+static uint32_t getU32(const unsigned char *buf) {
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+CompressedFileIO::CompressedFileIO(const shared_ptr<FileIO> &_base,
+                                   const FSConfigPtr &cfg)
+    : BlockFileIO(cfg->config->block_size() * ChunkBlocks, cfg),
+      base(_base),
+      indexSize(cfg->config->block_size()),
+      chunksPerIndex(cfg->config->block_size() / sizeof(uint32_t)),
+      indexNum(-1) {
+  rAssert(chunksPerIndex > 0);
+  indexData = new unsigned char[indexSize];
+}
+
+CompressedFileIO::~CompressedFileIO() {
+  memset(indexData, 0, indexSize);
+  delete[] indexData;
+}
+
+Interface CompressedFileIO::interface() const { return CompressedFileIO_iface; }
+
+int CompressedFileIO::open(int flags) { return base->open(flags); }
+
+void CompressedFileIO::setFileName(const char *fileName) {
+  base->setFileName(fileName);
+}
+
+const char *CompressedFileIO::getFileName() const {
+  return base->getFileName();
+}
+
+bool CompressedFileIO::setIV(uint64_t iv) { return base->setIV(iv); }
+
+off_t CompressedFileIO::indexOffset(off_t group) const {
+  return group * (indexSize + (off_t)chunksPerIndex * blockSize());
+}
+
+off_t CompressedFileIO::slotOffset(off_t chunk) const {
+  return indexOffset(chunk / chunksPerIndex) + indexSize +
+         (chunk % chunksPerIndex) * (off_t)blockSize();
+}
+
+// Size of the next layer for a file of the given size.
+off_t CompressedFileIO::rawSize(off_t size) const {
+  if (size == 0) return 0;
+
+  off_t lastChunk = (size - 1) / blockSize();
+  return slotOffset(lastChunk) + size - lastChunk * blockSize();
+}
+
+// Size of the file, given the size of the next layer.
+off_t CompressedFileIO::dataSize(off_t rawSize) const {
+  off_t groupSize = indexOffset(1);
+  off_t groups = rawSize / groupSize;
+  off_t partial = rawSize % groupSize;
+
+  off_t size = groups * chunksPerIndex * blockSize();
+  if (partial > indexSize) size += partial - indexSize;
+  return size;
+}
+
+int CompressedFileIO::getAttr(struct stat *stbuf) const {
+  int res = base->getAttr(stbuf);
+
+  if (res == 0 && S_ISREG(stbuf->st_mode))
+    stbuf->st_size = dataSize(stbuf->st_size);
+
+  return res;
+}
+
+off_t CompressedFileIO::getSize() const { return dataSize(base->getSize()); }
+
+void CompressedFileIO::loadIndex(off_t group) const {
+  if (group == indexNum) return;
+
+  IORequest req;
+  req.offset = indexOffset(group);
+  req.data = indexData;
+  req.dataLen = indexSize;
+  ssize_t readSize = base->read(req);
+  if (readSize < 0) readSize = 0;
+  memset(indexData + readSize, 0, indexSize - readSize);
+
+  indexNum = group;
+}
+
+uint32_t CompressedFileIO::storedLength(off_t chunk) const {
+  loadIndex(chunk / chunksPerIndex);
+  return getU32(indexData + (chunk % chunksPerIndex) * sizeof(uint32_t));
+}
+
+bool CompressedFileIO::writeIndex() {
+  // the next layer may encode in place, so write from a copy.
+  MemBlock mb;
+  mb.allocate(indexSize);
+  memcpy(mb.data, indexData, indexSize);
+
+  IORequest req;
+  req.offset = indexOffset(indexNum);
+  req.data = mb.data;
+  req.dataLen = indexSize;
+  if (!base->write(req)) {
+    indexNum = -1;
+    return false;
+  }
+  return true;
+}
+
+bool CompressedFileIO::setStoredLength(off_t chunk, uint32_t length) {
+  if (storedLength(chunk) == length) return true;
+
+  putU32(indexData + (chunk % chunksPerIndex) * sizeof(uint32_t), length);
+  return writeIndex();
+}
+
+// Mark the chunks from fromChunk to the end of its group as stored as-is.
+bool CompressedFileIO::clearIndex(off_t fromChunk) {
+  loadIndex(fromChunk / chunksPerIndex);
+
+  unsigned char *start =
+      indexData + (fromChunk % chunksPerIndex) * sizeof(uint32_t);
+  unsigned char *end = indexData + indexSize;
+  bool stale = false;
+  for (unsigned char *p = start; p < end; ++p)
+    if (*p != 0) stale = true;
+
+  if (!stale) return true;
+  memset(start, 0, end - start);
+  return writeIndex();
+}
+
+// Write everything passed on so far to the disk, before anything that is
+// written after it.
+bool CompressedFileIO::syncBase() {
+  if (base->flush() < 0) return false;
+
+  int fd = base->open(O_RDONLY);
+  if (fd < 0) return false;
+#ifdef linux
+  int res = ::fdatasync(fd);
+#else
+  int res = ::fsync(fd);
+#endif
+  // EINVAL / EROFS: the file doesn't support syncing.
+  if (res < 0 && errno != EINVAL && errno != EROFS) {
+    LOG(ERROR) << "sync failed for " << getFileName() << ": "
+               << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+// Mark a chunk as changing before its slot is rewritten, unless the slot stays
+// stored as-is and the old and new data can't be mixed up.
+bool CompressedFileIO::beginChunk(off_t chunk, uint32_t stored) {
+  if (storedLength(chunk) == 0 && stored == 0) return true;
+  return setStoredLength(chunk, ChunkChanging) && syncBase();
+}
+
+// Record the new stored length of a chunk once its slot is written.
+bool CompressedFileIO::endChunk(off_t chunk, uint32_t stored) {
+  if (storedLength(chunk) == ChunkChanging && !syncBase()) return false;
+  return setStoredLength(chunk, stored);
+}
+
+// Write a chunk which is not the last in the file, compressed if that saves
+// at least one block.  The data may be modified.
+bool CompressedFileIO::writeChunk(off_t chunk, unsigned char *data,
+                                  int length) {
+  IORequest req;
+  req.offset = slotOffset(chunk);
+  req.data = data;
+  req.dataLen = length;
+  uint32_t stored = 0;
+
+#ifdef HAVE_ZLIB
+  int bs = indexSize;
+  MemBlock mb;
+  mb.allocate(blockSize());
+  uLongf outLen = blockSize() - bs;
+  if (length == blockSize() &&
+      compress2(mb.data, &outLen, data, length, Z_BEST_SPEED) == Z_OK) {
+    stored = outLen;
+    req.data = mb.data;
+    req.dataLen = ((outLen + bs - 1) / bs) * bs;
+    memset(mb.data + outLen, 0, req.dataLen - outLen);
+  }
+#endif
+
+  if (!beginChunk(chunk, stored)) return false;
+  if (!base->write(req)) return false;
+  if (stored != 0) {
+    off_t used = req.dataLen;
+    int res = base->punchHole(req.offset + used, blockSize() - used);
+    if (res < 0 && res != -EOPNOTSUPP)
+      VLOG(1) << "unable to release space in chunk " << chunk << ": " << res;
+  }
+
+  return endChunk(chunk, stored);
+}
+
+// Called when a chunk stops being the last one in the file.
+bool CompressedFileIO::compactChunk(off_t chunk) {
+  if (storedLength(chunk) != 0) return true;
+
+  MemBlock mb;
+  mb.allocate(blockSize());
+
+  IORequest req;
+  req.offset = slotOffset(chunk);
+  req.data = mb.data;
+  req.dataLen = blockSize();
+  ssize_t readSize = base->read(req);
+  if (readSize != blockSize()) return true;
+
+  return writeChunk(chunk, mb.data, readSize);
+}
+
+ssize_t CompressedFileIO::readOneBlock(const IORequest &req) const {
+  off_t chunk = req.offset / blockSize();
+  uint32_t stored = storedLength(chunk);
+
+  IORequest tmp = req;
+  tmp.offset = slotOffset(chunk);
+  if (stored == 0) return base->read(tmp);
+  if (stored == ChunkChanging) {
+    LOG(ERROR) << "chunk " << chunk << " of " << getFileName()
+               << " was being rewritten when the file was last closed";
+    return -EIO;
+  }
+
+#ifdef HAVE_ZLIB
+  MemBlock mb;
+  mb.allocate(stored);
+  tmp.data = mb.data;
+  tmp.dataLen = stored;
+  ssize_t readSize = base->read(tmp);
+  if (readSize < 0) return readSize;
+
+  uLongf outLen = req.dataLen;
+  int res = uncompress(req.data, &outLen, mb.data, readSize);
+  if (res == Z_OK) return outLen;
+
+  LOG(ERROR) << "failed to decompress chunk " << chunk << " of "
+             << getFileName() << ": " << res;
+#else
+  LOG(ERROR) << "compressed chunk " << chunk << " of " << getFileName()
+             << ", but compression support is not available";
+#endif
+  return -EIO;
+}
+
+bool CompressedFileIO::writeOneBlock(const IORequest &req) {
+  off_t chunk = req.offset / blockSize();
+  off_t group = chunk / chunksPerIndex;
+
+  // the last chunk is always stored as-is, so the one it replaces as last
+  // chunk is compressed now.
+  off_t size = getSize();
+  off_t lastChunk = size > 0 ? (size - 1) / blockSize() : -1;
+  if (chunk > lastChunk && lastChunk >= 0 && !compactChunk(lastChunk))
+    return false;
+
+  // make sure the index exists before any data in its group.
+  if (base->getSize() < indexOffset(group) + indexSize) {
+    memset(indexData, 0, indexSize);
+    indexNum = group;
+    if (!writeIndex()) return false;
+  }
+
+  if (chunk < lastChunk) return writeChunk(chunk, req.data, req.dataLen);
+
+  IORequest tmp = req;
+  tmp.offset = slotOffset(chunk);
+  if (!beginChunk(chunk, 0)) return false;
+  if (!base->write(tmp)) return false;
+  return endChunk(chunk, 0);
+}
+
+int CompressedFileIO::truncate(off_t size) {
+  off_t oldSize = getSize();
+  int res = 0;
+
+  if (size >= oldSize) {
+    res = blockTruncate(size, 0);
+    if (res == 0) res = base->truncate(rawSize(size));
+    return res;
+  }
+
+  invalidateCache();
+  if (size == 0) {
+    indexNum = -1;
+    return base->truncate(0);
+  }
+
+  // the new last chunk has to be stored as-is.
+  off_t lastChunk = (size - 1) / blockSize();
+  int partial = size - lastChunk * blockSize();
+  if (storedLength(lastChunk) == 0) {
+    res = base->truncate(rawSize(size));
+  } else {
+    MemBlock mb;
+    mb.allocate(blockSize());
+
+    IORequest req;
+    req.offset = lastChunk * blockSize();
+    req.data = mb.data;
+    req.dataLen = blockSize();
+    ssize_t readSize = readOneBlock(req);
+    if (readSize < partial) return readSize < 0 ? readSize : -EIO;
+
+    if (!beginChunk(lastChunk, 0)) return -EIO;
+    res = base->truncate(slotOffset(lastChunk));
+    if (res == 0) {
+      req.offset = slotOffset(lastChunk);
+      req.dataLen = partial;
+      if (!base->write(req) || !endChunk(lastChunk, 0)) res = -EIO;
+    }
+  }
+
+  if (res == 0 && !clearIndex(lastChunk)) res = -EIO;
+  return res;
+}
+
+int CompressedFileIO::flush() { return base->flush(); }
+
+bool CompressedFileIO::isWritable() const { return base->isWritable(); }
+
+}  // namespace encfs
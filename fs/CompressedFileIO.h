@@ -0,0 +1,95 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CompressedFileIO_incl_
+#define _CompressedFileIO_incl_
+
+#include "fs/BlockFileIO.h"
+
+namespace encfs {
+
+/*
+    Compresses file data in fixed size chunks before it is passed on to the
+    next layer (normally CipherFileIO).
+
+    Every chunk has a slot of its full size in the next layer, so finding a
+    chunk is a simple calculation.  A compressed chunk is stored at the start
+    of its slot, and the rest of the slot is released with punchHole(), so the
+    space is only saved when the backing filesystem supports sparse files.
+    An index block in front of each group of slots records the compressed
+    length of each chunk, or 0 if it is stored as-is.  A chunk which changes
+    between the two is marked in the index while its slot is rewritten.
+
+    The last chunk of a file is always stored as-is, so that the file size can
+    be found from the size of the next layer without reading anything.
+*/
+class CompressedFileIO : public BlockFileIO {
+ public:
+  CompressedFileIO(const shared_ptr<FileIO> &base, const FSConfigPtr &cfg);
+  virtual ~CompressedFileIO();
+
+  virtual Interface interface() const;
+
+  virtual void setFileName(const char *fileName);
+  virtual const char *getFileName() const;
+  virtual bool setIV(uint64_t iv);
+
+  virtual int open(int flags);
+  virtual int getAttr(struct stat *stbuf) const;
+  virtual off_t getSize() const;
+
+  virtual int truncate(off_t size);
+  virtual int flush();
+
+  virtual bool isWritable() const;
+
+ private:
+  virtual ssize_t readOneBlock(const IORequest &req) const;
+  virtual bool writeOneBlock(const IORequest &req);
+
+  off_t indexOffset(off_t group) const;
+  off_t slotOffset(off_t chunk) const;
+  off_t rawSize(off_t size) const;
+  off_t dataSize(off_t rawSize) const;
+
+  void loadIndex(off_t group) const;
+  bool writeIndex();
+  uint32_t storedLength(off_t chunk) const;
+  bool setStoredLength(off_t chunk, uint32_t length);
+  bool clearIndex(off_t fromChunk);
+  bool syncBase();
+  bool beginChunk(off_t chunk, uint32_t stored);
+  bool endChunk(off_t chunk, uint32_t stored);
+
+  bool writeChunk(off_t chunk, unsigned char *data, int length);
+  bool compactChunk(off_t chunk);
+
+  shared_ptr<FileIO> base;
+  int indexSize;
+  int chunksPerIndex;
+
+  // the most recently used index block.
+  mutable off_t indexNum;
+  unsigned char *indexData;
+};
+
+}  // namespace encfs
+
+#endif
@@ -25,14 +25,75 @@
 #include "fs/FileUtils.h"
 #include "fs/DirNode.h"
 
+#include <glog/logging.h>
+
+#include <cstdlib>
+#include <new>
+
 namespace encfs {
 
-EncFS_Context::EncFS_Context() : publicFilesystem(false), running(false) {
+// Upper bound on the number of entries in the symlink and page cache maps.
+// The maps are simply emptied when they fill up.
+static const unsigned int MaxCacheEntries = 4096;
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+
+void EncFS_Context::StatStamp::set(const struct stat &st) {
+  ino = st.st_ino;
+  mtime = st.st_mtim;
+  ctime = st.st_ctim;
+  size = st.st_size;
+}
+
+bool EncFS_Context::StatStamp::matches(const struct stat &st) const {
+  return ino == st.st_ino && mtime.tv_sec == st.st_mtim.tv_sec &&
+         mtime.tv_nsec == st.st_mtim.tv_nsec &&
+         ctime.tv_sec == st.st_ctim.tv_sec &&
+         ctime.tv_nsec == st.st_ctim.tv_nsec && size == st.st_size;
+}
+
+// Whether a file was last changed long enough ago that another change
+// would show in its stamp.  Timestamps only advance with the clock tick of
+// the backing filesystem, which is taken to be 10ms when it stores
+// sub-second times, and 2 seconds (FAT) otherwise.
+static bool settledStamp(const struct stat &st) {
+  struct timespec now;
+  if (clock_gettime(CLOCK_REALTIME, &now) != 0) return false;
+
+  int64_t grain = (st.st_mtim.tv_nsec || st.st_ctim.tv_nsec)
+                      ? 10 * 1000 * 1000LL
+                      : 2 * 1000 * 1000 * 1000LL;
+  int64_t age = (int64_t)(now.tv_sec - st.st_ctim.tv_sec) * 1000000000LL +
+                (now.tv_nsec - st.st_ctim.tv_nsec);
+  return age > grain;
+}
+
+static const shared_ptr<DirNode> NoRoot;
+
 #ifdef CMAKE_USE_PTHREADS_INIT
-  pthread_cond_init(&wakeupCond, 0);
+// hand the slot of an exiting thread back for reuse.
+static void releaseSlot(void *slot) {
+  static_cast<EncFS_Context::EpochSlot *>(slot)->inUse = false;
+}
 #endif
 
-  usageCount = 0;
+EncFS_Context::EncFS_Context()
+    : publicFilesystem(false),
+      running(false),
+      openNameCount(0),
+      openInodeCount(0),
+      missingGeneration(0),
+      xattrGeneration(0),
+      busy(false),
+      currentRoot(NULL),
+      epoch(1) {
+#ifdef CMAKE_USE_PTHREADS_INIT
+  pthread_cond_init(&wakeupCond, 0);
+  pthread_key_create(&slotKey, releaseSlot);
+#endif
 }
 
 EncFS_Context::~EncFS_Context() {
@@ -42,33 +103,278 @@ EncFS_Context::~EncFS_Context() {
 
   // release all entries from map
   openFiles.clear();
+  openNameCount = 0;
+  openInodes.clear();
+  openInodeCount = 0;
+  linkTargets.clear();
+  cachedFiles.clear();
+  missingPaths.clear();
+  xattrs.clear();
+
+#ifdef CMAKE_USE_PTHREADS_INIT
+  pthread_key_delete(slotKey);
+#endif
+  for (size_t i = 0; i < retiredRoots.size(); ++i) delete retiredRoots[i].root;
+  delete currentRoot.load();
+  for (size_t i = 0; i < epochSlots.size(); ++i) delete epochSlots[i];
+}
+
+void *EncFS_Context::EpochSlot::operator new(size_t size) {
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, 64, size) != 0) throw std::bad_alloc();
+  return ptr;
+}
+
+void EncFS_Context::EpochSlot::operator delete(void *ptr) { free(ptr); }
+
+EncFS_Context::EpochSlot *EncFS_Context::threadSlot() {
+#ifdef CMAKE_USE_PTHREADS_INIT
+  EpochSlot *slot = static_cast<EpochSlot *>(pthread_getspecific(slotKey));
+  if (slot) return slot;
+
+  Lock lock(contextMutex);
+  for (size_t i = 0; i < epochSlots.size() && !slot; ++i) {
+    bool free = false;
+    if (epochSlots[i]->inUse.compare_exchange_strong(free, true))
+      slot = epochSlots[i];
+  }
+  if (!slot) {
+    slot = new EpochSlot;
+    epochSlots.push_back(slot);
+  }
+
+  pthread_setspecific(slotKey, slot);
+  return slot;
+#else
+  Lock lock(contextMutex);
+  if (epochSlots.empty()) epochSlots.push_back(new EpochSlot);
+  return epochSlots[0];
+#endif
+}
+
+EncFS_Context::RootPin::RootPin(EncFS_Context *_ctx)
+    : ctx(_ctx), slot(_ctx->threadSlot()) {
+  if (slot->depth++ == 0) slot->active = ctx->epoch.load();
+}
+
+EncFS_Context::RootPin::~RootPin() {
+  if (--slot->depth == 0) slot->active.store(0, std::memory_order_release);
 }
 
-shared_ptr<DirNode> EncFS_Context::getRoot(int *errCode) {
-  shared_ptr<DirNode> ret;
-  do {
-    {
-      Lock lock(contextMutex);
-      ret = root;
-      ++usageCount;
+const shared_ptr<DirNode> &EncFS_Context::RootPin::root(int *err) {
+  for (;;) {
+    shared_ptr<DirNode> *r = ctx->currentRoot.load();
+    if (r) {
+      if (!ctx->busy.load(std::memory_order_relaxed))
+        ctx->busy.store(true, std::memory_order_relaxed);
+      return *r;
     }
 
-    if (!ret) {
-      int res = remountFS(this);
-      if (res != 0) {
-        *errCode = res;
-        break;
-      }
+    int res = remountFS(ctx);
+    if (res != 0) {
+      *err = res;
+      return NoRoot;
     }
-  } while (!ret);
+  }
+}
+
+void EncFS_Context::reclaimRoots() {
+  if (retiredRoots.empty()) return;
+
+  // the oldest epoch any thread is still pinned in.
+  uint64_t oldest = epoch.load();
+  for (size_t i = 0; i < epochSlots.size(); ++i) {
+    uint64_t active = epochSlots[i]->active.load();
+    if (active != 0 && active < oldest) oldest = active;
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < retiredRoots.size(); ++i) {
+    if (retiredRoots[i].epoch < oldest)
+      delete retiredRoots[i].root;
+    else
+      retiredRoots[kept++] = retiredRoots[i];
+  }
+  retiredRoots.resize(kept);
+}
+
+bool EncFS_Context::lookupLink(const std::string &cipherPath,
+                               const struct stat &st, std::string *target) {
+  Lock lock(contextMutex);
+
+  LinkMap::const_iterator it = linkTargets.find(cipherPath);
+  if (it == linkTargets.end()) return false;
+
+  if (!it->second.stamp.matches(st)) return false;
+
+  *target = it->second.target;
+  return true;
+}
+
+void EncFS_Context::storeLink(const std::string &cipherPath,
+                              const struct stat &st,
+                              const std::string &target) {
+  Lock lock(contextMutex);
+
+  if (linkTargets.size() >= MaxCacheEntries) linkTargets.clear();
+
+  LinkEntry &e = linkTargets[cipherPath];
+  e.stamp.set(st);
+  e.target = target;
+}
+
+void EncFS_Context::clearLink(const char *cipherPath) {
+  Lock lock(contextMutex);
+
+  if (cipherPath)
+    linkTargets.erase(cipherPath);
+  else
+    linkTargets.clear();
+}
+
+bool EncFS_Context::keepCache(const std::string &cipherPath,
+                              const struct stat &st) {
+  Lock lock(contextMutex);
+
+  StampMap::const_iterator it = cachedFiles.find(cipherPath);
+  return (it != cachedFiles.end()) && it->second.matches(st);
+}
+
+void EncFS_Context::releasedFile(const std::string &cipherPath,
+                                 const struct stat &st) {
+  Lock lock(contextMutex);
+
+  // a file released right after a change could change again without its
+  // stamp moving, so the kernel isn't told to keep its cache then.
+  if (!settledStamp(st)) {
+    cachedFiles.erase(cipherPath);
+    return;
+  }
 
-  return ret;
+  if (cachedFiles.size() >= MaxCacheEntries) cachedFiles.clear();
+
+  cachedFiles[cipherPath].set(st);
+}
+
+bool EncFS_Context::lookupMissing(const char *path, uint64_t *generation) {
+  // nothing is ever stored without a timeout, so don't take the lock.
+  if (!opts || opts->negativeTimeout <= 0) {
+    *generation = 0;
+    return false;
+  }
+
+  Lock lock(contextMutex);
+
+  *generation = missingGeneration;
+  if (missingPaths.empty()) return false;
+
+  MissingMap::iterator it = missingPaths.find(path);
+  if (it == missingPaths.end()) return false;
+
+  if (it->second < time(0)) {
+    missingPaths.erase(it);
+    return false;
+  }
+  return true;
+}
+
+void EncFS_Context::storeMissing(const char *path, uint64_t generation) {
+  if (!opts || opts->negativeTimeout <= 0) return;
+
+  Lock lock(contextMutex);
+
+  if (generation != missingGeneration) return;
+
+  if (missingPaths.size() >= MaxCacheEntries) missingPaths.clear();
+
+  missingPaths[path] = time(0) + opts->negativeTimeout;
+}
+
+void EncFS_Context::clearMissing(const char *path) {
+  if (!opts || opts->negativeTimeout <= 0) return;
+
+  Lock lock(contextMutex);
+
+  ++missingGeneration;
+  if (path)
+    missingPaths.erase(path);
+  else
+    missingPaths.clear();
+}
+
+bool EncFS_Context::lookupXattr(const char *path, const char *name,
+                                uint64_t *generation, bool *present,
+                                std::string *value) {
+  Lock lock(xattrMutex);
+
+  *generation = xattrGeneration;
+  if (xattrs.empty()) return false;
+
+  XattrMap::iterator it = xattrs.find(path);
+  if (it == xattrs.end()) return false;
+
+  XattrSet::iterator entry = it->second.find(name);
+  if (entry == it->second.end()) return false;
+
+  if (entry->second.expiry < time(0)) {
+    it->second.erase(entry);
+    if (it->second.empty()) xattrs.erase(it);
+    return false;
+  }
+
+  *present = entry->second.present;
+  *value = entry->second.value;
+  return true;
+}
+
+void EncFS_Context::storeXattr(const char *path, const char *name,
+                               uint64_t generation, bool present,
+                               const std::string &value) {
+  Lock lock(xattrMutex);
+
+  if (generation != xattrGeneration) return;
+
+  if (xattrs.size() >= MaxCacheEntries) xattrs.clear();
+
+  XattrEntry &e = xattrs[path][name];
+  e.expiry = time(0) + 1;
+  e.present = present;
+  e.value = value;
+}
+
+void EncFS_Context::clearXattrs(const char *path) {
+  Lock lock(xattrMutex);
+
+  ++xattrGeneration;
+  if (path)
+    xattrs.erase(path);
+  else
+    xattrs.clear();
 }
 
 void EncFS_Context::setRoot(const shared_ptr<DirNode> &r) {
   Lock lock(contextMutex);
 
   root = r;
+
+  // requests pinned before the epoch moves on may still use the old root.
+  shared_ptr<DirNode> *old =
+      currentRoot.exchange(r ? new shared_ptr<DirNode>(r) : NULL);
+  if (old) {
+    RetiredRoot retired = {old, epoch.fetch_add(1)};
+    retiredRoots.push_back(retired);
+  }
+  reclaimRoots();
+
+  linkTargets.clear();
+  cachedFiles.clear();
+  missingPaths.clear();
+  ++missingGeneration;
+  {
+    Lock xattrLock(xattrMutex);
+    xattrs.clear();
+    ++xattrGeneration;
+  }
   if (r) rootCipherDir = r->rootDirectory();
 }
 
@@ -77,22 +383,31 @@ bool EncFS_Context::isMounted() const { return root; }
 int EncFS_Context::getAndResetUsageCounter() {
   Lock lock(contextMutex);
 
-  int count = usageCount;
-  usageCount = 0;
+  // the idle monitor calls this regularly, which is a good time to release
+  // replaced roots that were still pinned when they were replaced.
+  reclaimRoots();
 
-  return count;
+  return busy.exchange(false) ? 1 : 0;
 }
 
-int EncFS_Context::openFileCount() const {
-  Lock lock(contextMutex);
+int EncFS_Context::openFileCount() const { return openNameCount; }
+
+bool EncFS_Context::hasOpenInodes() const { return openInodeCount > 0; }
 
-  return openFiles.size();
+// Key for looking up a path, in a buffer kept per thread so that it only
+// allocates while growing.
+static const std::string &pathKey(const char *path) {
+  static thread_local std::string key;
+  key.assign(path);
+  return key;
 }
 
 shared_ptr<FileNode> EncFS_Context::lookupNode(const char *path) {
+  if (openNameCount == 0) return shared_ptr<FileNode>();
+
   Lock lock(contextMutex);
 
-  FileMap::iterator it = openFiles.find(std::string(path));
+  FileMap::iterator it = openFiles.find(pathKey(path));
   if (it != openFiles.end()) {
     // all the items in the set point to the same node.. so just use the
     // first
@@ -102,6 +417,19 @@ shared_ptr<FileNode> EncFS_Context::lookupNode(const char *path) {
   }
 }
 
+bool EncFS_Context::lookupCipherName(const char *path,
+                                     std::string *cipherName) {
+  if (openNameCount == 0) return false;
+
+  Lock lock(contextMutex);
+
+  FileMap::iterator it = openFiles.find(pathKey(path));
+  if (it == openFiles.end()) return false;
+
+  cipherName->assign((*it->second.begin())->node->cipherName());
+  return true;
+}
+
 void EncFS_Context::renameNode(const char *from, const char *to) {
   Lock lock(contextMutex);
 
@@ -110,19 +438,72 @@ void EncFS_Context::renameNode(const char *from, const char *to) {
     std::set<Placeholder *> val = it->second;
     openFiles.erase(it);
     openFiles[std::string(to)] = val;
+    openNameCount = openFiles.size();
   }
 }
 
-shared_ptr<FileNode> EncFS_Context::getNode(void *pl) {
+void EncFS_Context::closedName(const std::string &path,
+                               const shared_ptr<FileNode> &node) {
+  // A node shared by hard links carries the name it was first opened with.
+  // Once that name is closed it may be unlinked or replaced, so switch the
+  // node to a name which is still open.
+  if (!root) return;
+
+  for (FileMap::iterator it = openFiles.begin(); it != openFiles.end(); ++it) {
+    if (it->second.empty() || (*it->second.begin())->node != node) continue;
+
+    try {
+      if (root->cipherPath(path.c_str()) != node->cipherName()) return;
+
+      std::string cname = root->cipherPath(it->first.c_str());
+      VLOG(1) << "renaming shared node " << node->cipherName() << " -> "
+              << cname;
+      node->setName(it->first.c_str(), cname.c_str(), 0);
+    }
+    catch (Error &err) {
+      LOG(ERROR) << "error renaming shared node: " << err.what();
+    }
+    return;
+  }
+}
+
+const shared_ptr<FileNode> &EncFS_Context::getNode(void *pl) {
   Placeholder *ph = static_cast<Placeholder *>(pl);
   return ph->node;
 }
 
+shared_ptr<FileNode> EncFS_Context::lookupInode(const struct stat &st) {
+  Lock lock(contextMutex);
+
+  InodeMap::const_iterator it = openInodes.find(InodeKey(st.st_dev, st.st_ino));
+  if (it == openInodes.end()) return shared_ptr<FileNode>();
+
+  return it->second.node;
+}
+
 void *EncFS_Context::putNode(const char *path,
-                             const shared_ptr<FileNode> &node) {
+                             const shared_ptr<FileNode> &node,
+                             const struct stat *st) {
   Lock lock(contextMutex);
   Placeholder *pl = new Placeholder(node);
   openFiles[std::string(path)].insert(pl);
+  openNameCount = openFiles.size();
+
+  if (st && S_ISREG(st->st_mode)) {
+    InodeKey key(st->st_dev, st->st_ino);
+    InodeEntry &entry = openInodes[key];
+    if (!entry.node) entry.node = node;
+
+    // a different node may already have the inode if it was opened through
+    // another name while this one was being opened.  It is left out of the
+    // index then.
+    if (entry.node == node) {
+      pl->indexed = true;
+      pl->inode = key;
+      ++entry.refs;
+    }
+    openInodeCount = openInodes.size();
+  }
 
   return (void *)pl;
 }
@@ -145,9 +526,17 @@ void EncFS_Context::eraseNode(const char *path, void *pl) {
     // unencrypted filenames.. not sure this does any good..
     std::string storedName = it->first;
     openFiles.erase(it);
+    openNameCount = openFiles.size();
+    if (ph->indexed) closedName(storedName, ph->node);
     storedName.assign(storedName.length(), '\0');
   }
 
+  if (ph->indexed) {
+    InodeMap::iterator in = openInodes.find(ph->inode);
+    if (in != openInodes.end() && --in->second.refs == 0) openInodes.erase(in);
+    openInodeCount = openInodes.size();
+  }
+
   delete ph;
 }
 
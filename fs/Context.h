@@ -25,8 +25,15 @@
 #include "base/shared_ptr.h"
 #include "base/Mutex.h"
 
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <atomic>
+#include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #ifdef HAVE_TR1_UNORDERED_MAP
 #include <tr1/unordered_map>
@@ -42,26 +49,112 @@ struct EncFS_Args;
 struct EncFS_Opts;
 class FileNode;
 class DirNode;
+class Trash;
 
 class EncFS_Context {
  public:
   EncFS_Context();
   ~EncFS_Context();
 
-  static shared_ptr<FileNode> getNode(void *ptr);
+  // the node stays referenced by its placeholder until release, so callers
+  // can use it without taking another reference.
+  static const shared_ptr<FileNode> &getNode(void *ptr);
   shared_ptr<FileNode> lookupNode(const char *path);
+  // cipher name of an open file, without taking a reference to its node.
+  bool lookupCipherName(const char *path, std::string *cipherName);
+
+  // find the open node of a backing file, given its stat info.  Hard links
+  // to an open file share its node.
+  shared_ptr<FileNode> lookupInode(const struct stat &st);
 
   int getAndResetUsageCounter();
   int openFileCount() const;
 
-  void *putNode(const char *path, const shared_ptr<FileNode> &node);
+  // true if lookupInode can find anything, without taking the lock.
+  bool hasOpenInodes() const;
+
+  // st is the stat info of the opened file, if known, which lets other
+  // names for the file find the node.
+  void *putNode(const char *path, const shared_ptr<FileNode> &node,
+                const struct stat *st = NULL);
 
   void eraseNode(const char *path, void *placeholder);
 
   void renameNode(const char *oldName, const char *newName);
 
+  // Cache of decoded symlink targets, indexed by cipher path.  An entry is
+  // only returned if the link still matches the stat info it was stored
+  // with, so a replaced link is never served a stale target.
+  bool lookupLink(const std::string &cipherPath, const struct stat &st,
+                  std::string *target);
+  void storeLink(const std::string &cipherPath, const struct stat &st,
+                 const std::string &target);
+  // forget the target of a link changed through encfs, or every target if
+  // cipherPath is NULL.
+  void clearLink(const char *cipherPath);
+
+  // Page cache policy.  The kernel may keep its cached plaintext for a file
+  // if the cipher file is unchanged since the last time it was released
+  // through encfs.  Anything else, such as changes made directly to the
+  // cipher directory, makes the kernel drop its cache on the next open.
+  // Files released within a timestamp tick of a change aren't remembered,
+  // since a further change in the same tick would leave the stamp as is.
+  bool keepCache(const std::string &cipherPath, const struct stat &st);
+  void releasedFile(const std::string &cipherPath, const struct stat &st);
+
+  // Negative lookup cache, indexed by plaintext path.  Entries expire after
+  // the negative timeout given in the options, and none are kept without
+  // one.  Take the generation before looking up a path, so a missing entry
+  // isn't stored if the path was created in the meantime.
+  bool lookupMissing(const char *path, uint64_t *generation);
+  void storeMissing(const char *path, uint64_t generation);
+  // forget a path which was created through encfs, or every entry if path
+  // is NULL.
+  void clearMissing(const char *path);
+
+  // Extended attribute cache, indexed by plaintext path and attribute name.
+  // Missing attributes are cached as well, and entries expire after a
+  // second, like the attributes the kernel caches.  The generation works as
+  // for missing paths.  Keying by the backing inode would need an lstat per
+  // lookup, which costs about as much as the getxattr being saved, so
+  // changes made through one hard link have to clear every path.  The cache
+  // has a mutex of its own, so lookups don't wait on the context mutex.
+  bool lookupXattr(const char *path, const char *name, uint64_t *generation,
+                   bool *present, std::string *value);
+  void storeXattr(const char *path, const char *name, uint64_t generation,
+                  bool present, const std::string &value);
+  // forget the attributes of a path changed through encfs, or every entry
+  // if path is NULL, as for changes which other hard links also see.
+  void clearXattrs(const char *path);
+
+  struct EpochSlot;
+
+  /*
+      Pins the root directory node for the length of a request.
+
+      A request reads the root without taking the context lock or touching
+      the reference count, which would otherwise bounce the same cache lines
+      between all CPUs on every request.  Pinning only writes to a slot which
+      belongs to the calling thread.  A root replaced by setRoot is released
+      once no thread is still pinned from before the change.
+  */
+  class RootPin {
+   public:
+    explicit RootPin(EncFS_Context *ctx);
+    ~RootPin();
+
+    // the root, remounting if necessary.  Empty on failure, with *err set.
+    const shared_ptr<DirNode> &root(int *err);
+
+   private:
+    RootPin(const RootPin &src);             // not allowed
+    RootPin &operator=(const RootPin &src);  // not allowed
+
+    EncFS_Context *ctx;
+    EpochSlot *slot;
+  };
+
   void setRoot(const shared_ptr<DirNode> &root);
-  shared_ptr<DirNode> getRoot(int *err);
   bool isMounted() const;
 
   shared_ptr<EncFS_Args> args;
@@ -71,6 +164,9 @@ class EncFS_Context {
   // root path to cipher dir
   std::string rootCipherDir;
 
+  // set when deleted files are moved to the trash rather than unlinked
+  shared_ptr<Trash> trash;
+
   // for idle monitor
   bool running;
 
@@ -90,23 +186,114 @@ class EncFS_Context {
    * release() is called.  shared_ptr then does our reference counting for
    * us.
    */
+  typedef std::pair<dev_t, ino_t> InodeKey;
+
   struct Placeholder {
     shared_ptr<FileNode> node;
+    bool indexed;
+    InodeKey inode;
 
-    Placeholder(const shared_ptr<FileNode> &ptr) : node(ptr) {}
+    Placeholder(const shared_ptr<FileNode> &ptr) : node(ptr), indexed(false) {}
   };
 
   // set of open files, indexed by path
   typedef unordered_map<std::string, std::set<Placeholder *> > FileMap;
 
+  // open nodes by backing inode, with the number of placeholders for each.
+  struct InodeEntry {
+    shared_ptr<FileNode> node;
+    int refs;
+
+    InodeEntry() : refs(0) {}
+  };
+  typedef std::map<InodeKey, InodeEntry> InodeMap;
+
 #ifdef CMAKE_USE_PTHREADS_INIT
   mutable Mutex contextMutex;
+  Mutex xattrMutex;
 #endif
 
   FileMap openFiles;
+  std::atomic<int> openNameCount;  // size of openFiles
+  InodeMap openInodes;
+  std::atomic<int> openInodeCount;  // size of openInodes
+
+  void closedName(const std::string &path, const shared_ptr<FileNode> &node);
+
+  // identifies a particular version of a cipher file.
+  struct StatStamp {
+    ino_t ino;
+    struct timespec mtime;
+    struct timespec ctime;
+    off_t size;
+
+    void set(const struct stat &st);
+    bool matches(const struct stat &st) const;
+  };
+
+  struct LinkEntry {
+    StatStamp stamp;
+    std::string target;
+  };
+  typedef unordered_map<std::string, LinkEntry> LinkMap;
+  typedef unordered_map<std::string, StatStamp> StampMap;
+
+  LinkMap linkTargets;
+  StampMap cachedFiles;
+
+  // expiry time of missing paths.
+  typedef unordered_map<std::string, time_t> MissingMap;
+  MissingMap missingPaths;
+  uint64_t missingGeneration;
+
+  struct XattrEntry {
+    time_t expiry;
+    bool present;
+    std::string value;
+  };
+  typedef std::map<std::string, XattrEntry> XattrSet;
+  typedef unordered_map<std::string, XattrSet> XattrMap;
+
+  XattrMap xattrs;
+  uint64_t xattrGeneration;
+
+  // set by requests, cleared by the idle monitor.  Only written when it
+  // changes, so busy requests don't keep writing to it.
+  std::atomic<bool> busy;
 
-  int usageCount;
   shared_ptr<DirNode> root;
+
+  // Current root for pinned requests, and replaced roots waiting until no
+  // pin from the epoch they were replaced in is left.
+  struct RetiredRoot {
+    shared_ptr<DirNode> *root;
+    uint64_t epoch;
+  };
+
+  std::atomic<shared_ptr<DirNode> *> currentRoot;
+  std::atomic<uint64_t> epoch;
+  std::vector<RetiredRoot> retiredRoots;
+  std::vector<EpochSlot *> epochSlots;
+
+#ifdef CMAKE_USE_PTHREADS_INIT
+  pthread_key_t slotKey;
+#endif
+
+  EpochSlot *threadSlot();
+  void reclaimRoots();
+};
+
+// Per thread pin state, on a cache line of its own.  Plain new doesn't
+// honour the alignment before C++17, so slots allocate themselves.
+struct alignas(64) EncFS_Context::EpochSlot {
+  std::atomic<uint64_t> active;  // epoch pinned by the owner, 0 if none
+  std::atomic<bool> inUse;       // owned by a thread
+  int depth;                     // nested pins, only used by the owner
+
+  EpochSlot() : active(0), inUse(true), depth(0) {}
+
+  static void *operator new(size_t size);
+  static void operator delete(void *ptr);
 };
 
 int remountFS(EncFS_Context *ctx);
@@ -37,6 +37,7 @@
 #include "fs/Context.h"
 #include "fs/DirNode.h"
 #include "fs/FileUtils.h"
+#include "fs/Trash.h"
 #include "fs/fsconfig.pb.h"
 
 #include <glog/logging.h>
@@ -54,16 +55,17 @@ class DirDeleter {
 };
 
 DirTraverse::DirTraverse(const shared_ptr<DIR> &_dirPtr, uint64_t _iv,
-                         const shared_ptr<NameIO> &_naming)
-    : dir(_dirPtr), iv(_iv), naming(_naming) {}
+                         const shared_ptr<NameIO> &_naming, const char *_hidden)
+    : dir(_dirPtr), iv(_iv), naming(_naming), hidden(_hidden) {}
 
 DirTraverse::DirTraverse(const DirTraverse &src)
-    : dir(src.dir), iv(src.iv), naming(src.naming) {}
+    : dir(src.dir), iv(src.iv), naming(src.naming), hidden(src.hidden) {}
 
 DirTraverse &DirTraverse::operator=(const DirTraverse &src) {
   dir = src.dir;
   iv = src.iv;
   naming = src.naming;
+  hidden = src.hidden;
 
   return *this;
 }
@@ -98,14 +100,15 @@ static bool _nextName(struct dirent *&de, const shared_ptr<DIR> &dir,
 std::string DirTraverse::nextPlaintextName(int *fileType, ino_t *inode) {
   struct dirent *de = 0;
   while (_nextName(de, dir, fileType, inode)) {
-    try {
-      uint64_t localIv = iv;
-      return naming->decodePath(de->d_name, &localIv);
-    }
-    catch (Error &ex) {
-      // .. .problem decoding, ignore it and continue on to next name..
-      VLOG(1) << "error decoding filename " << de->d_name << " : " << ex.what();
-    }
+    if (hidden && !strcmp(de->d_name, hidden)) continue;
+
+    uint64_t localIv = iv;
+    string plainName;
+    if (naming->tryDecodePath(de->d_name, &localIv, &plainName))
+      return plainName;
+
+    // .. .problem decoding, ignore it and continue on to next name..
+    VLOG(1) << "error decoding filename " << de->d_name;
   }
 
   return string();
@@ -115,14 +118,12 @@ std::string DirTraverse::nextInvalid() {
   struct dirent *de = 0;
   // find the first name which produces a decoding error...
   while (_nextName(de, dir, (int *)0, (ino_t *)0)) {
-    try {
-      uint64_t localIv = iv;
-      naming->decodePath(de->d_name, &localIv);
-      continue;
-    }
-    catch (Error &ex) {
+    if (hidden && !strcmp(de->d_name, hidden)) continue;
+
+    uint64_t localIv = iv;
+    string plainName;
+    if (!naming->tryDecodePath(de->d_name, &localIv, &plainName))
       return string(de->d_name);
-    }
   }
 
   return string();
@@ -260,6 +261,10 @@ DirNode::DirNode(EncFS_Context *_ctx, const string &sourceDir,
   if (rootDir[rootDir.length() - 1] != '/') rootDir.append(1, '/');
 
   naming = fsConfig->nameCoding;
+
+  // reverse mode shows the source directory as it is, and has no trash.
+  if (!fsConfig->opts || !fsConfig->opts->reverseEncryption)
+    trashDir = rootDir + TrashDirName;
 }
 
 DirNode::~DirNode() {}
@@ -268,6 +273,13 @@ bool DirNode::hasDirectoryNameDependency() const {
   return naming ? naming->getChainedNameIV() : false;
 }
 
+bool DirNode::isTrash(const string &cipherPath) const {
+  if (trashDir.empty() || cipherPath.compare(0, trashDir.length(), trashDir))
+    return false;
+  return cipherPath.length() == trashDir.length() ||
+         cipherPath[trashDir.length()] == '/';
+}
+
 string DirNode::rootDirectory() const {
   // don't update last access here, otherwise 'du' would cause lastAccess to
   // be reset.
@@ -276,10 +288,18 @@ string DirNode::rootDirectory() const {
 }
 
 string DirNode::cipherPath(const char *plaintextPath) {
+  string result;
+  cipherPath(plaintextPath, &result);
+  return result;
+}
+
+void DirNode::cipherPath(const char *plaintextPath, string *result) {
   if (plaintextPath[0] == '/') {
     ++plaintextPath;
   }
-  return rootDir + naming->encodePath(plaintextPath);
+  uint64_t iv = 0;
+  result->assign(rootDir);
+  naming->appendEncodedPath(plaintextPath, strlen(plaintextPath), &iv, result);
 }
 
 string DirNode::cipherPathWithoutRoot(const char *plaintextPath) {
@@ -287,17 +307,16 @@ string DirNode::cipherPathWithoutRoot(const char *plaintextPath) {
 }
 
 string DirNode::plainPath(const char *cipherPath_) {
-  try {
-    if (!strncmp(cipherPath_, rootDir.c_str(), rootDir.length())) {
-      return naming->decodePath(cipherPath_ + rootDir.length());
-    } else {
-      return naming->decodePath(cipherPath_);
-    }
-  }
-  catch (Error &err) {
-    LOG(ERROR) << "decode err: " << err.what();
+  if (!strncmp(cipherPath_, rootDir.c_str(), rootDir.length()))
+    cipherPath_ += rootDir.length();
+
+  uint64_t iv = 0;
+  string plain;
+  if (!naming->tryDecodePath(cipherPath_, &iv, &plain)) {
+    LOG(ERROR) << "decode err: invalid encoded path";
     return string();
   }
+  return plain;
 }
 
 string DirNode::relativeCipherPath(const char *plaintextPath) {
@@ -330,7 +349,11 @@ DirTraverse DirNode::openDir(const char *plaintextPath) {
     catch (Error &err) {
       LOG(ERROR) << "encode err: " << err.what();
     }
-    return DirTraverse(dp, iv, naming);
+    // names that don't decode are skipped anyway, but with NullNameIO the
+    // trash directory would show up in the root.
+    bool root = cyName.length() <= rootDir.length();
+    return DirTraverse(dp, iv, naming,
+                       (root && !trashDir.empty()) ? TrashDirName : 0);
   }
 }
 
@@ -367,13 +390,8 @@ bool DirNode::genRenameList(list<RenameEl> &renameList, const char *fromP,
       continue;
     }
 
-    try {
-      plainName = naming->decodePath(de->d_name, &localIV);
-    }
-    catch (Error &ex) {
-      // if filename can't be decoded, then ignore it..
-      continue;
-    }
+    // if filename can't be decoded, then ignore it..
+    if (!naming->tryDecodePath(de->d_name, &localIV, &plainName)) continue;
 
     // any error in the following will trigger a rename failure.
     try {
@@ -454,6 +472,7 @@ int DirNode::mkdir(const char *plaintextPath, mode_t mode, uid_t uid,
                    gid_t gid) {
   string cyName = cipherPath(plaintextPath);
   rAssert(!cyName.empty());
+  if (isTrash(cyName)) return -EPERM;
 
   VLOG(1) << "mkdir on " << cyName;
 
@@ -486,6 +505,7 @@ int DirNode::rename(const char *fromPlaintext, const char *toPlaintext) {
   string toCName = cipherPath(toPlaintext);
   rAssert(!fromCName.empty());
   rAssert(!toCName.empty());
+  if (isTrash(fromCName) || isTrash(toCName)) return -EPERM;
 
   VLOG(1) << "rename " << fromCName << " -> " << toCName;
 
@@ -548,6 +568,7 @@ int DirNode::link(const char *from, const char *to) {
 
   rAssert(!fromCName.empty());
   rAssert(!toCName.empty());
+  if (isTrash(fromCName) || isTrash(toCName)) return -EPERM;
 
   VLOG(1) << "link " << fromCName << " -> " << toCName;
 
@@ -596,7 +617,8 @@ shared_ptr<FileNode> DirNode::renameNode(const char *from, const char *to,
   return node;
 }
 
-shared_ptr<FileNode> DirNode::findOrCreate(const char *plainName) {
+shared_ptr<FileNode> DirNode::findOrCreate(const char *plainName,
+                                           bool shareLinks) {
   shared_ptr<FileNode> node;
   if (ctx) node = ctx->lookupNode(plainName);
 
@@ -605,9 +627,31 @@ shared_ptr<FileNode> DirNode::findOrCreate(const char *plainName) {
     if (plainName[0] == '/') {
       ++plainName;
     }
-    string cipherName = naming->encodePath(plainName, &iv);
-    node.reset(new FileNode(this, fsConfig, plainName,
-                            (rootDir + cipherName).c_str()));
+    // FileNode keeps a copy of the name, so it is built in a buffer kept
+    // per thread.
+    static thread_local string cipherName;
+    cipherName.assign(rootDir);
+    naming->appendEncodedPath(plainName, strlen(plainName), &iv, &cipherName);
+
+    // Hard links to a file which is already open share its node, so there
+    // is one IO stack and cache for the file.  Links aren't allowed with
+    // external IV chaining.  The backing file is only checked while some
+    // file is open.
+    if (shareLinks && ctx && ctx->hasOpenInodes() &&
+        !fsConfig->config->external_iv()) {
+      struct stat st;
+      if (::lstat(cipherName.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+          st.st_nlink > 1) {
+        node = ctx->lookupInode(st);
+        if (node) {
+          VLOG(1) << "sharing FileNode of " << node->cipherName() << " for "
+                  << cipherName;
+          return node;
+        }
+      }
+    }
+
+    node.reset(new FileNode(this, fsConfig, plainName, cipherName.c_str()));
 
     if (fsConfig->config->external_iv()) node->setName(0, 0, iv);
 
@@ -622,7 +666,8 @@ shared_ptr<FileNode> DirNode::lookupNode(const char *plainName,
   (void)requestor;
   Lock _lock(mutex);
 
-  shared_ptr<FileNode> node = findOrCreate(plainName);
+  shared_ptr<FileNode> node = findOrCreate(plainName, true);
+  if (node && isTrash(node->cipherName())) return shared_ptr<FileNode>();
 
   return node;
 }
@@ -639,11 +684,25 @@ shared_ptr<FileNode> DirNode::openNode(const char *plainName,
   rAssert(result != NULL);
   Lock _lock(mutex);
 
-  shared_ptr<FileNode> node = findOrCreate(plainName);
+  shared_ptr<FileNode> node = findOrCreate(plainName, true);
+  if (node && isTrash(node->cipherName())) {
+    *result = -ENOENT;
+    return shared_ptr<FileNode>();
+  }
 
-  if (node && (*result = node->open(flags)) >= 0)
+  if (node && (*result = node->open(flags)) >= 0) {
+    // The lower layers never pass O_TRUNC through to the backing file, since
+    // that would throw away the file header.  Handle it here, while still
+    // holding the lock, using the truncate-to-zero fast path.
+    if ((flags & O_TRUNC) && (flags & (O_WRONLY | O_RDWR))) {
+      int res = node->truncate(0);
+      if (res < 0) {
+        *result = res;
+        return shared_ptr<FileNode>();
+      }
+    }
     return node;
-  else
+  } else
     return shared_ptr<FileNode>();
 }
 
@@ -661,6 +720,9 @@ int DirNode::unlink(const char *plaintextName) {
     LOG(WARNING) << "Refusing to unlink open file: " << cyName
                  << ", hard_remove option is probably in effect";
     res = -EBUSY;
+  } else if (ctx && ctx->trash && ctx->trash->add(cyName) == 0) {
+    // moved out of the way, the space is freed in the background.
+    res = 0;
   } else {
     res = ::unlink(cyName.c_str());
     if (res == -1) {
@@ -46,8 +46,9 @@ class EncFS_Context;
 
 class DirTraverse {
  public:
+  // hidden is a cipher name to skip, if not null.
   DirTraverse(const shared_ptr<DIR> &dirPtr, uint64_t iv,
-              const shared_ptr<NameIO> &naming);
+              const shared_ptr<NameIO> &naming, const char *hidden = 0);
   DirTraverse(const DirTraverse &src);
   ~DirTraverse();
 
@@ -73,6 +74,7 @@ class DirTraverse {
   // more efficient to support filename IV chaining..
   uint64_t iv;
   shared_ptr<NameIO> naming;
+  const char *hidden;
 };
 inline bool DirTraverse::valid() const { return dir != 0; }
 
@@ -99,6 +101,9 @@ class DirNode {
                                 int *openResult);
 
   std::string cipherPath(const char *plaintextPath);
+  // Same as cipherPath, but stores the result in a caller supplied string,
+  // which can be reused between calls to avoid allocating.
+  void cipherPath(const char *plaintextPath, std::string *result);
   std::string cipherPathWithoutRoot(const char *plaintextPath);
   std::string plainPath(const char *cipherPath);
 
@@ -114,6 +119,10 @@ class DirNode {
   */
   bool hasDirectoryNameDependency() const;
 
+  // True for the trash directory or anything in it, which the plaintext
+  // view never shows or creates.
+  bool isTrash(const std::string &cipherPath) const;
+
   // unlink the specified file
   int unlink(const char *plaintextName);
 
@@ -156,7 +165,9 @@ class DirNode {
   bool genRenameList(std::list<RenameEl> &list, const char *fromP,
                      const char *toP);
 
-  shared_ptr<FileNode> findOrCreate(const char *plainName);
+  // with shareLinks, a hard link to an open file returns the open node.
+  shared_ptr<FileNode> findOrCreate(const char *plainName,
+                                    bool shareLinks = false);
 
   Mutex mutex;
 
@@ -166,6 +177,9 @@ class DirNode {
   std::string rootDir;
   FSConfigPtr fsConfig;
 
+  // cipher path of the trash directory, empty in reverse mode.
+  std::string trashDir;
+
   shared_ptr<NameIO> naming;
 };
 
@@ -20,6 +20,8 @@
 
 #include "fs/FileIO.h"
 
+#include <cerrno>
+
 namespace encfs {
 
 FileIO::FileIO() {}
@@ -33,4 +35,18 @@ bool FileIO::setIV(uint64_t iv) {
   return true;
 }
 
+int FileIO::allocate(off_t offset, off_t length) {
+  if (offset + length > getSize()) return truncate(offset + length);
+
+  return 0;
+}
+
+int FileIO::punchHole(off_t offset, off_t length) {
+  (void)offset;
+  (void)length;
+  return -EOPNOTSUPP;
+}
+
+int FileIO::flush() { return 0; }
+
 }  // namespace encfs
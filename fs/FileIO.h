@@ -70,6 +70,22 @@ class FileIO {
 
   virtual int truncate(off_t size) = 0;
 
+  // Reserve space for the given range, extending the file if necessary.
+  // Returns 0 on success, -errno on failure.  The default implementation
+  // just extends the file using truncate().
+  virtual int allocate(off_t offset, off_t length);
+
+  // Release the storage for the given range, which afterwards reads as
+  // zeros (or, for encoded layers, as undefined data).  The file size is not
+  // changed.  Returns 0 on success, -errno on failure.  The default
+  // implementation returns -EOPNOTSUPP.
+  virtual int punchHole(off_t offset, off_t length);
+
+  // Pass on any data held back by this layer to the layers below.  Returns 0
+  // on success, -errno on failure.  The default implementation has nothing
+  // to write and returns 0.
+  virtual int flush();
+
   virtual bool isWritable() const = 0;
 
  private:
@@ -44,6 +44,10 @@
 #include "fs/FileNode.h"
 #include "fs/FileUtils.h"
 #include "fs/MACFileIO.h"
+#include "fs/MerkleFileIO.h"
+#include "fs/CompressedFileIO.h"
+#include "fs/WriteLogFileIO.h"
+#include "fs/MmapFileIO.h"
 #include "fs/RawFileIO.h"
 #include "fs/fsconfig.pb.h"
 
@@ -62,6 +66,18 @@ namespace encfs {
    sent to the IO subsystem!
 */
 
+/*
+   With the null cipher and no per-file header, MACs or compression, the
+   backing file holds the plaintext unchanged, so reads and writes can go
+   straight to the backing file without being split into blocks.
+*/
+static bool isPassthrough(const FSConfigPtr &cfg) {
+  const EncfsConfig &config = *cfg->config;
+  return cfg->cipher->isNull() && !config.unique_iv() &&
+         !config.block_mac_bytes() && !config.block_mac_rand_bytes() &&
+         !config.merkle_tree() && !config.compression();
+}
+
 FileNode::FileNode(DirNode *parent_, const FSConfigPtr &cfg,
                    const char *plaintextName_, const char *cipherName_) {
   Lock _lock(mutex);
@@ -73,11 +89,34 @@ FileNode::FileNode(DirNode *parent_, const FSConfigPtr &cfg,
   this->fsConfig = cfg;
 
   // chain RawFileIO & CipherFileIO
-  shared_ptr<FileIO> rawIO(new RawFileIO(_cname));
+  shared_ptr<RawFileIO> rawIO;
+  if (cfg->opts && cfg->opts->mmapRead)
+    rawIO.reset(new MmapFileIO(_cname));
+  else
+    rawIO.reset(new RawFileIO(_cname));
+  if (cfg->opts) rawIO->setDropCache(cfg->opts->dropBackingCache);
+  rawIO->setTrackChanges(cfg->config->change_tracking());
+
+  // the write log needs a block layer to collect writes into, and there is
+  // no encoding for it to save here.
+  if (isPassthrough(cfg)) {
+    io = rawIO;
+    return;
+  }
+
   io = shared_ptr<FileIO>(new CipherFileIO(rawIO, fsConfig));
 
-  if (cfg->config->block_mac_bytes() || cfg->config->block_mac_rand_bytes())
+  if (cfg->config->merkle_tree())
+    io = shared_ptr<FileIO>(new MerkleFileIO(io, fsConfig));
+  else if (cfg->config->block_mac_bytes() ||
+           cfg->config->block_mac_rand_bytes())
     io = shared_ptr<FileIO>(new MACFileIO(io, fsConfig));
+
+  if (cfg->config->compression())
+    io = shared_ptr<FileIO>(new CompressedFileIO(io, fsConfig));
+
+  if (cfg->opts && cfg->opts->writeLog)
+    io = shared_ptr<FileIO>(new WriteLogFileIO(io, fsConfig));
 }
 
 FileNode::~FileNode() {
@@ -94,6 +133,8 @@ const char *FileNode::plaintextName() const { return _pname.c_str(); }
 
 string FileNode::plaintextParent() const { return parentDirectory(_pname); }
 
+Interface FileNode::interface() const { return io->interface(); }
+
 static bool setIV(const shared_ptr<FileIO> &io, uint64_t iv) {
   struct stat stbuf;
   if ((io->getAttr(&stbuf) < 0) || S_ISREG(stbuf.st_mode))
@@ -161,8 +202,12 @@ int FileNode::mknod(mode_t mode, dev_t rdev, uid_t uid, gid_t gid) {
    * The regular file stuff could be stripped off if there
    * were a create method (advised to have)
    */
+  // the hash tree writes its root block into a new file straight away, so it
+  // has to be writable until then.
+  bool withRoot = S_ISREG(mode) && fsConfig->config->merkle_tree();
   if (S_ISREG(mode)) {
-    res = ::open(_cname.c_str(), O_CREAT | O_EXCL | O_WRONLY, mode);
+    res = ::open(_cname.c_str(), O_CREAT | O_EXCL | O_WRONLY,
+                 withRoot ? (mode | S_IWUSR) : mode);
     if (res >= 0) res = ::close(res);
   } else if (S_ISFIFO(mode))
     res = ::mkfifo(_cname.c_str(), mode);
@@ -178,6 +223,20 @@ int FileNode::mknod(mode_t mode, dev_t rdev, uid_t uid, gid_t gid) {
     res = -eno;
   }
 
+  if (res == 0 && withRoot) {
+    // an empty file without a root would look like one which was cut off.
+    res = io->open(O_RDWR);
+    if (res >= 0) res = io->truncate(0);
+    struct stat st;
+    if (res == 0 && !(mode & S_IWUSR) && ::stat(_cname.c_str(), &st) == 0 &&
+        ::chmod(_cname.c_str(), st.st_mode & ~S_IWUSR & 07777) == -1)
+      res = -errno;
+    if (res < 0) {
+      VLOG(1) << "unable to set up new file: " << strerror(-res);
+      ::unlink(_cname.c_str());
+    }
+  }
+
   return res;
 }
 
@@ -232,12 +291,26 @@ int FileNode::truncate(off_t size) {
   return io->truncate(size);
 }
 
+int FileNode::allocate(off_t offset, off_t length) {
+  Lock _lock(mutex);
+
+  return io->allocate(offset, length);
+}
+
+int FileNode::flush() {
+  Lock _lock(mutex);
+
+  return io->flush();
+}
+
 int FileNode::sync(bool datasync) {
   Lock _lock(mutex);
 
+  int res = io->flush();
+  if (res < 0) return res;
+
   int fh = io->open(O_RDONLY);
   if (fh >= 0) {
-    int res;
 #ifdef linux
     if (datasync)
       res = fdatasync(fh);
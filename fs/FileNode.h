@@ -21,6 +21,7 @@
 #ifndef _FileNode_incl_
 #define _FileNode_incl_
 
+#include "base/Interface.h"
 #include "base/Mutex.h"
 #include "cipher/CipherKey.h"
 #include "fs/encfs.h"
@@ -48,6 +49,9 @@ class FileNode {
   // directory portion of plaintextName
   std::string plaintextParent() const;
 
+  // interface of the top FileIO layer.
+  Interface interface() const;
+
   // if setIVFirst is true, then the IV is changed before the name is changed
   // (default).  The reverse is also supported for special cases..
   bool setName(const char *plaintextName, const char *cipherName, uint64_t iv,
@@ -70,6 +74,12 @@ class FileNode {
   // truncate the file to a particular size
   int truncate(off_t size);
 
+  // reserve space for a range of the file, extending it if necessary
+  int allocate(off_t offset, off_t length);
+
+  // write out any data held back by the FileIO layers.
+  int flush();
+
   // datasync or full sync
   int sync(bool dataSync);
 
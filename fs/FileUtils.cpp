@@ -76,6 +76,9 @@ using std::string;
 namespace encfs {
 
 static const int DefaultBlockSize = 2048;
+// Alignment of file data when aligned headers are chosen, a typical page and
+// filesystem block size.
+static const int DefaultHeaderAlign = 4096;
 // The maximum length of text passwords.  If longer are needed,
 // use the extpass option, as extpass can return arbitrary length binary data.
 static const int MaxPassBuf = 2048;
@@ -90,7 +93,7 @@ static const char ENCFS_ENV_STDOUT[] = "encfs_stdout";
 static const char ENCFS_ENV_STDERR[] = "encfs_stderr";
 
 const int V5Latest = 20040813;  // fix MACFileIO block size issues
-const int ProtoSubVersion = 20120902;
+const int ProtoSubVersion = 20261018;  // new FileIO layers and options
 
 const char ConfigFileName[] = ".encfs.txt";
 
@@ -563,7 +566,11 @@ static Interface selectNameCoding(const CipherV1::CipherAlgorithm &alg) {
     NameIO::AlgorithmList::const_iterator it;
     int optNum = 1;
     map<int, NameIO::AlgorithmList::const_iterator> algMap;
+    shared_ptr<CipherV1> cipher = CipherV1::New(alg.iface);
     for (it = algorithms.begin(); it != algorithms.end(); ++it) {
+      // skip encodings which can't be used with the selected cipher.
+      if (cipher && !NameIO::New(it->iface, cipher)) continue;
+
       cout << optNum << ". " << it->name << " : "
            << gettext(it->description.c_str()) << "\n";
       algMap[optNum++] = it;
@@ -740,6 +747,40 @@ static void selectBlockMAC(int *macBytes, int *macRandBytes) {
   *macRandBytes = randSize;
 }
 
+static bool selectMerkleTree() {
+  // xgroup(setup)
+  return boolDefaultNo(
+      _("Enable block integrity checking with a hash tree?\n"
+        "This keeps a hash of every block separately from the data, which\n"
+        "adds about 0.5% to the storage requirements for a file.  Any\n"
+        "modification of a block, or reordering or truncating blocks\n"
+        "will be caught and will cause a read error."));
+}
+
+#ifdef HAVE_ZLIB
+static bool selectCompression() {
+  // xgroup(setup)
+  return boolDefaultNo(
+      _("Enable file data compression?\n"
+        "File data is compressed in chunks before it is encrypted, which\n"
+        "saves space for compressible files if the filesystem supports\n"
+        "sparse files.  The size of the compressed data is visible in the\n"
+        "encrypted files, and can reveal information about the contents,\n"
+        "for example when an attacker can add chosen data to a file."));
+}
+#endif
+
+#ifdef HAVE_XATTR
+static bool selectChangeTracking() {
+  // xgroup(setup)
+  return boolDefaultNo(
+      _("Enable change tracking for incremental backups?\n"
+        "Changed parts of each encrypted file are recorded in an extended\n"
+        "attribute, so that backup tools can copy only those parts.  The\n"
+        "underlying filesystem must support user extended attributes."));
+}
+#endif
+
 static bool boolDefaultYes(const char *prompt) {
   cout << prompt << "\n";
   cout << _("The default here is Yes.\n"
@@ -764,6 +805,16 @@ static bool selectUniqueIV() {
         "which rely on block-aligned file io for performance."));
 }
 
+static bool selectAlignedHeader() {
+  // xgroup(setup)
+  return boolDefaultNo(
+      _("Align file data to 4096 byte pages?\n"
+        "This pads the per-file header to 4096 bytes, so that encrypted\n"
+        "blocks do not straddle pages of the underlying filesystem.\n"
+        "It speeds up reads and writes, but adds 4KB to every file and\n"
+        "the filesystem can not be read by older versions of EncFS."));
+}
+
 static bool selectChainedIV() {
   // xgroup(setup)
   return boolDefaultYes(
@@ -833,6 +884,10 @@ RootPtr createConfig(EncFS_Context *ctx, const shared_ptr<EncFS_Opts> &opts) {
   bool chainedIV = false;
   bool externalIV = false;
   bool allowHoles = true;
+  int headerAlign = 0;
+  bool merkleTree = false;
+  bool compression = false;
+  bool changeTracking = false;
   long desiredKDFDuration = NormalKDFDuration;
 
   if (reverseEncryption) {
@@ -908,6 +963,7 @@ RootPtr createConfig(EncFS_Context *ctx, const shared_ptr<EncFS_Opts> &opts) {
     } else {
       chainedIV = selectChainedIV();
       uniqueIV = selectUniqueIV();
+      if (uniqueIV && selectAlignedHeader()) headerAlign = DefaultHeaderAlign;
       if (chainedIV && uniqueIV)
         externalIV = selectExternalChainedIV();
       else {
@@ -918,7 +974,18 @@ RootPtr createConfig(EncFS_Context *ctx, const shared_ptr<EncFS_Opts> &opts) {
         externalIV = false;
       }
       selectBlockMAC(&blockMACBytes, &blockMACRandBytes);
+      if (blockMACBytes == 0 && blockMACRandBytes == 0)
+        merkleTree = selectMerkleTree();
+#ifdef HAVE_ZLIB
+      // compressed chunks can only release space when the blocks below
+      // them can be dropped, which the integrity layers don't allow.
+      if (blockMACBytes == 0 && blockMACRandBytes == 0 && !merkleTree)
+        compression = selectCompression();
+#endif
       allowHoles = selectZeroBlockPassThrough();
+#ifdef HAVE_XATTR
+      changeTracking = selectChangeTracking();
+#endif
     }
     desiredKDFDuration = selectKDFDuration();
   }
@@ -946,6 +1013,10 @@ RootPtr createConfig(EncFS_Context *ctx, const shared_ptr<EncFS_Opts> &opts) {
   config.set_chained_iv(chainedIV);
   config.set_external_iv(externalIV);
   config.set_allow_holes(allowHoles);
+  if (headerAlign) config.set_header_align(headerAlign);
+  if (merkleTree) config.set_merkle_tree(true);
+  if (compression) config.set_compression(true);
+  if (changeTracking) config.set_change_tracking(true);
 
   EncryptedKey *key = config.mutable_key();
   key->clear_salt();
@@ -1126,6 +1197,23 @@ void showFSInfo(const EncfsConfig &config) {
     // xgroup(diag)
     cout << _("Each file contains 8 byte header with unique IV data.\n");
   }
+  if (config.merkle_tree()) {
+    // xgroup(diag)
+    cout << _("Block integrity checked with a hash tree.\n");
+  }
+  if (config.compression()) {
+    // xgroup(diag)
+    cout << _("File data is compressed before encryption.\n");
+  }
+  if (config.change_tracking()) {
+    // xgroup(diag)
+    cout << _("Changes to encrypted files are recorded for backups.\n");
+  }
+  if (config.header_align()) {
+    // xgroup(diag)
+    cout << autosprintf(_("File data aligned to %i byte boundaries.\n"),
+                        config.header_align());
+  }
   if (config.chained_iv()) {
     // xgroup(diag)
     cout << _("Filenames encoded using IV chaining mode.\n");
@@ -1404,15 +1492,34 @@ RootPtr initFS(EncFS_Context *ctx, const shared_ptr<EncFS_Opts> &opts) {
   EncfsConfig config;
 
   if (readConfig(opts->rootDir, config) != Config_None) {
+    if (config.revision() > ProtoSubVersion) {
+      LOG(ERROR) << "Config revision " << config.revision()
+                 << " found, but this version of encfs only supports up to "
+                 << ProtoSubVersion;
+      // xgroup(diag)
+      cout << _("The filesystem was created by a newer version of EncFS\n");
+      return rootInfo;
+    }
+
     if (opts->reverseEncryption) {
       if (config.block_mac_bytes() != 0 || config.block_mac_rand_bytes() != 0 ||
-          config.unique_iv() || config.external_iv() || config.chained_iv()) {
+          config.merkle_tree() || config.compression() || config.unique_iv() ||
+          config.external_iv() || config.chained_iv()) {
         cout
             << _("The configuration loaded is not compatible with --reverse\n");
         return rootInfo;
       }
     }
 
+#ifndef HAVE_ZLIB
+    if (config.compression()) {
+      LOG(ERROR) << "Compressed filesystem, but built without zlib";
+      // xgroup(diag)
+      cout << _("This version of EncFS does not support compression\n");
+      return rootInfo;
+    }
+#endif
+
     // first, instanciate the cipher.
     shared_ptr<CipherV1> cipher = getCipher(config);
     if (!cipher) {
@@ -82,6 +82,12 @@ struct EncFS_Opts {
 
   bool reverseEncryption;  // Reverse encryption
 
+  bool dropBackingCache;  // don't keep ciphertext in the page cache
+  bool mmapRead;          // read backing files through a memory mapping
+  bool writeLog;          // collect written blocks in memory until flush
+  bool deferredDelete;    // free space of deleted files in the background
+  int negativeTimeout;    // seconds to remember missing paths, 0 == never
+
   ConfigMode configMode;
 
   EncFS_Opts() {
@@ -95,6 +101,11 @@ struct EncFS_Opts {
     annotate = false;
     ownerCreate = false;
     reverseEncryption = false;
+    dropBackingCache = false;
+    mmapRead = false;
+    writeLog = false;
+    deferredDelete = false;
+    negativeTimeout = 0;
     configMode = Config_Prompt;
   }
 };
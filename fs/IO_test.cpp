@@ -19,18 +19,37 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <list>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 #include "fs/testing.h"
 
+#include "base/config.h"
+#include "base/Error.h"
 #include "cipher/MemoryPool.h"
 
+#include "fs/ChangeRecord.h"
+#include "fs/Context.h"
 #include "fs/CipherFileIO.h"
+#include "fs/CompressedFileIO.h"
+#include "fs/DirNode.h"
+#include "fs/FileNode.h"
 #include "fs/FileUtils.h"
 #include "fs/FSConfig.h"
 #include "fs/MACFileIO.h"
+#include "fs/MerkleFileIO.h"
 #include "fs/MemFileIO.h"
+#include "fs/MmapFileIO.h"
+#include "fs/NullNameIO.h"
+#include "fs/Trash.h"
+#include "fs/WriteLogFileIO.h"
 
 using namespace encfs;
 
@@ -72,6 +91,486 @@ TEST(IOTest, NullMacIO) { runWithCipher("Null", 512, testMacIO); }
 
 TEST(IOTest, MacIO) { runWithAllCiphers(testMacIO); }
 
+void testMacIOChecked(FSConfigPtr& cfg) {
+  cfg->config->set_block_mac_bytes(8);
+  cfg->config->set_block_mac_rand_bytes(4);
+  testMacIO(cfg);
+
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<MACFileIO> test(new MACFileIO(base, cfg));
+
+  int bs = test->blockSize();
+  byte buf[64 * 512];
+  memset(buf, 0x55, sizeof(buf));
+  IORequest req;
+  req.offset = 0;
+  req.data = buf;
+  req.dataLen = 40 * bs + bs / 2;
+  ASSERT_TRUE(test->write(req));
+
+  // reads of many blocks check them all, including past the first batch.
+  shared_ptr<MACFileIO> reread(new MACFileIO(base, cfg));
+  ASSERT_EQ(req.dataLen, reread->read(req));
+
+  byte raw[1];
+  IORequest rawReq;
+  rawReq.offset = 35 * cfg->config->block_size() + 20;
+  rawReq.data = raw;
+  rawReq.dataLen = 1;
+  ASSERT_EQ(1, base->read(rawReq));
+  raw[0] ^= 1;
+  ASSERT_TRUE(base->write(rawReq));
+
+  shared_ptr<MACFileIO> tampered(new MACFileIO(base, cfg));
+  EXPECT_THROW(tampered->read(req), Error);
+}
+
+TEST(IOTest, CheckedMacIO) { runWithAllCiphers(testMacIOChecked); }
+
+void testMerkleIO(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<MerkleFileIO> test(new MerkleFileIO(base, cfg));
+  ASSERT_EQ(0, test->truncate(0));
+
+  shared_ptr<MemFileIO> dup(new MemFileIO(0));
+  comparisonTest(cfg, test.get(), dup.get());
+
+  // grow past several hash nodes, then shrink into the middle of one.
+  int bs = cfg->config->block_size();
+  int nodeSpan = bs * (bs / 8);
+  truncate(test.get(), dup.get(), 2 * nodeSpan + bs / 3);
+  truncate(test.get(), dup.get(), nodeSpan + 5 * bs);
+
+  // a new reader verifies the stored tree.
+  shared_ptr<MerkleFileIO> reread(new MerkleFileIO(base, cfg));
+  ASSERT_EQ(dup->getSize(), reread->getSize());
+  compare(reread.get(), dup.get(), 0, dup->getSize());
+}
+
+TEST(IOTest, NullMerkleIO) { runWithCipher("Null", 512, testMerkleIO); }
+
+TEST(IOTest, MerkleIO) { runWithAllCiphers(testMerkleIO); }
+
+void testMerkleIOTamper(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<MerkleFileIO> test(new MerkleFileIO(base, cfg));
+  ASSERT_EQ(0, test->truncate(0));
+
+  int bs = cfg->config->block_size();
+  byte buf[4096];
+  memset(buf, 0x55, sizeof(buf));
+  IORequest req;
+  req.offset = 0;
+  req.data = buf;
+  req.dataLen = sizeof(buf);
+  ASSERT_TRUE(test->write(req));
+  ASSERT_EQ(0, test->flush());
+
+  // change the second data block, which follows the root, the first data
+  // block and the first node.
+  byte raw[4096];
+  req.offset = 3 * bs;
+  req.data = raw;
+  req.dataLen = bs;
+  ASSERT_EQ(bs, base->read(req));
+  raw[0] ^= 1;
+  ASSERT_TRUE(base->write(req));
+
+  shared_ptr<MerkleFileIO> reread(new MerkleFileIO(base, cfg));
+  req.offset = bs;
+  req.data = buf;
+  req.dataLen = bs;
+  EXPECT_THROW(reread->read(req), Error);
+
+  // cutting off the last block is also caught.
+  raw[0] ^= 1;
+  req.offset = 3 * bs;
+  req.data = raw;
+  req.dataLen = bs;
+  ASSERT_TRUE(base->write(req));
+  ASSERT_EQ(0, base->truncate(base->getSize() - bs));
+
+  shared_ptr<MerkleFileIO> cut(new MerkleFileIO(base, cfg));
+  req.offset = 0;
+  req.data = buf;
+  req.dataLen = bs;
+  EXPECT_THROW(cut->read(req), Error);
+}
+
+TEST(IOTest, MerkleIOTamper) { runWithCipher("Null", 512, testMerkleIOTamper); }
+
+// Memory file which counts the reads and writes passed to it.
+class CountingMemFileIO : public MemFileIO {
+ public:
+  CountingMemFileIO() : MemFileIO(0), reads(0), writes(0) {}
+  virtual ssize_t read(const IORequest& req) const {
+    ++reads;
+    return MemFileIO::read(req);
+  }
+  virtual bool write(const IORequest& req) {
+    ++writes;
+    return MemFileIO::write(req);
+  }
+  mutable int reads;
+  int writes;
+};
+
+static shared_ptr<MemFileIO> copyOf(MemFileIO* io) {
+  shared_ptr<MemFileIO> copy(new MemFileIO(io->getSize()));
+  std::vector<byte> data(io->getSize());
+  IORequest req;
+  req.offset = 0;
+  req.data = data.data();
+  req.dataLen = data.size();
+  io->read(req);
+  copy->write(req);
+  return copy;
+}
+
+void testMerkleIOBatched(FSConfigPtr& cfg) {
+  shared_ptr<CountingMemFileIO> base(new CountingMemFileIO());
+  shared_ptr<MerkleFileIO> test(new MerkleFileIO(base, cfg));
+  ASSERT_EQ(0, test->truncate(0));
+  base->writes = 0;
+
+  // several groups of blocks, each covered by one node.
+  int bs = cfg->config->block_size();
+  int blocks = 3 * (bs / 8) + 8;
+  std::vector<byte> buf(blocks * bs);
+  cfg->cipher->pseudoRandomize(buf.data(), buf.size());
+  IORequest req;
+  req.offset = 0;
+  req.data = buf.data();
+  req.dataLen = buf.size();
+  ASSERT_TRUE(test->write(req));
+
+  // only the data and a root per group are written before the flush.
+  EXPECT_GE(blocks + 4, base->writes);
+  int before = base->writes;
+  ASSERT_EQ(0, test->flush());
+  EXPECT_GE(6, base->writes - before);
+
+  // a read checks only the nodes above the block.
+  shared_ptr<MerkleFileIO> reread(new MerkleFileIO(base, cfg));
+  std::vector<byte> tmp(bs);
+  req.offset = (blocks - 10) * bs;
+  req.data = tmp.data();
+  req.dataLen = bs;
+  base->reads = 0;
+  ASSERT_EQ(bs, reread->read(req));
+  EXPECT_GE(4, base->reads);
+  EXPECT_EQ(0, memcmp(tmp.data(), &buf[req.offset], bs));
+}
+
+TEST(IOTest, MerkleIOBatched) { runWithCipher("Null", 512, testMerkleIOBatched); }
+
+void testMerkleIORecovery(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<MerkleFileIO> test(new MerkleFileIO(base, cfg));
+  ASSERT_EQ(0, test->truncate(0));
+
+  int bs = cfg->config->block_size();
+  int blocks = 3 * (bs / 8) + 8;
+  std::vector<byte> buf(blocks * bs);
+  cfg->cipher->pseudoRandomize(buf.data(), buf.size());
+  IORequest req;
+  req.offset = 0;
+  req.data = buf.data();
+  req.dataLen = buf.size();
+  ASSERT_TRUE(test->write(req));
+  ASSERT_EQ(0, test->flush());
+
+  // change a block and grow the file, then stop before the flush.
+  std::vector<byte> more(3 * bs);
+  cfg->cipher->pseudoRandomize(more.data(), more.size());
+  memcpy(&buf[5 * bs], more.data(), bs);
+  req.offset = 5 * bs;
+  req.data = more.data();
+  req.dataLen = bs;
+  ASSERT_TRUE(test->write(req));
+  buf.insert(buf.end(), more.begin() + bs, more.end());
+  req.offset = blocks * bs;
+  req.data = more.data() + bs;
+  req.dataLen = 2 * bs;
+  ASSERT_TRUE(test->write(req));
+
+  // the changed blocks can't be checked, so reading them fails, while the
+  // rest of the file can still be read.
+  shared_ptr<MemFileIO> crashed = copyOf(base.get());
+  shared_ptr<MerkleFileIO> damaged(new MerkleFileIO(crashed, cfg));
+  ASSERT_EQ((off_t)buf.size(), damaged->getSize());
+  std::vector<byte> tmp(buf.size());
+  req.offset = 5 * bs;
+  req.data = tmp.data();
+  req.dataLen = bs;
+  EXPECT_THROW(damaged->read(req), Error);
+  req.offset = 2 * (bs / 8) * bs;
+  ASSERT_EQ(bs, damaged->read(req));
+  EXPECT_EQ(0, memcmp(tmp.data(), &buf[req.offset], bs));
+  damaged.reset();
+
+  // until a repair is asked for.
+  cfg->opts->forceDecode = true;
+  shared_ptr<MerkleFileIO> repaired(new MerkleFileIO(crashed, cfg));
+  req.offset = 0;
+  req.dataLen = tmp.size();
+  ASSERT_EQ((ssize_t)tmp.size(), repaired->read(req));
+  repaired.reset();
+  cfg->opts->forceDecode = false;
+
+  shared_ptr<MerkleFileIO> recovered(new MerkleFileIO(crashed, cfg));
+  ASSERT_EQ((off_t)buf.size(), recovered->getSize());
+  memset(tmp.data(), 0, tmp.size());
+  ASSERT_EQ((ssize_t)tmp.size(), recovered->read(req));
+  EXPECT_EQ(0, memcmp(tmp.data(), buf.data(), buf.size()));
+
+  // blocks outside of the changing groups are still checked.
+  off_t blockNum = 2 * (bs / 8) + 1;
+  shared_ptr<MemFileIO> raw = copyOf(base.get());
+  byte flip[1];
+  IORequest rawReq;
+  rawReq.offset = -1;
+  rawReq.data = flip;
+  rawReq.dataLen = 1;
+  std::vector<byte> block(bs);
+  for (off_t offset = 0; offset < raw->getSize(); offset += bs) {
+    // find the block by its content, as its place depends on the layout.
+    IORequest find;
+    find.offset = offset;
+    find.data = block.data();
+    find.dataLen = bs;
+    if (raw->read(find) == bs &&
+        memcmp(block.data(), &buf[blockNum * bs], bs) == 0) {
+      rawReq.offset = offset;
+      break;
+    }
+  }
+  ASSERT_LE(0, rawReq.offset);
+  ASSERT_EQ(1, raw->read(rawReq));
+  flip[0] ^= 1;
+  ASSERT_TRUE(raw->write(rawReq));
+  shared_ptr<MerkleFileIO> broken(new MerkleFileIO(raw, cfg));
+  req.offset = blockNum * bs;
+  req.dataLen = bs;
+  EXPECT_THROW(broken->read(req), Error);
+}
+
+TEST(IOTest, MerkleIORecovery) {
+  runWithCipher("Null", 512, testMerkleIORecovery);
+}
+
+void testMerkleIOCut(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<MerkleFileIO> test(new MerkleFileIO(base, cfg));
+  ASSERT_EQ(0, test->truncate(0));
+
+  // an empty file still has its root.
+  int bs = cfg->config->block_size();
+  ASSERT_EQ(bs, base->getSize());
+  byte buf[100];
+  IORequest req;
+  req.offset = 0;
+  req.data = buf;
+  req.dataLen = sizeof(buf);
+  shared_ptr<MerkleFileIO> empty(new MerkleFileIO(base, cfg));
+  ASSERT_EQ(0, empty->read(req));
+
+  memset(buf, 0x55, sizeof(buf));
+  ASSERT_TRUE(test->write(req));
+  ASSERT_EQ(0, test->flush());
+
+  // cutting the file down to its root, or to nothing, is caught.
+  shared_ptr<MemFileIO> rootOnly = copyOf(base.get());
+  ASSERT_EQ(0, rootOnly->truncate(bs));
+  shared_ptr<MerkleFileIO> cut(new MerkleFileIO(rootOnly, cfg));
+  EXPECT_THROW(cut->read(req), Error);
+
+  ASSERT_EQ(0, base->truncate(0));
+  shared_ptr<MerkleFileIO> gone(new MerkleFileIO(base, cfg));
+  EXPECT_THROW(gone->read(req), Error);
+}
+
+TEST(IOTest, MerkleIOCut) { runWithCipher("Null", 512, testMerkleIOCut); }
+
+void testCompressedIO(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<CipherFileIO> cipherIO(new CipherFileIO(base, cfg));
+  shared_ptr<CompressedFileIO> test(new CompressedFileIO(cipherIO, cfg));
+  shared_ptr<MemFileIO> dup(new MemFileIO(0));
+  comparisonTest(cfg, test.get(), dup.get());
+
+  // several chunks of compressible data.
+  int chunkSize = test->blockSize();
+  int size = 4 * chunkSize + chunkSize / 3;
+  MemBlock mb;
+  mb.allocate(size);
+  for (int i = 0; i < size; ++i) mb.data[i] = "compressible"[i % 12];
+
+  IORequest req;
+  req.offset = 0;
+  req.data = mb.data;
+  req.dataLen = size;
+  ASSERT_TRUE(dup->write(req));
+  ASSERT_TRUE(test->write(req));
+  ASSERT_EQ(size, test->getSize());
+
+  // partial writes into compressed chunks, then truncate into one.
+  for (int i = 0; i < 20; ++i) {
+    int len = 1 + random() % 512;
+    writeRandom(cfg, test.get(), dup.get(), random() % (size - len), len);
+  }
+  truncate(test.get(), dup.get(), 2 * chunkSize + 100);
+  truncate(test.get(), dup.get(), 3 * chunkSize);
+
+  // a new reader finds the same data through the chunk index.
+  shared_ptr<CompressedFileIO> reread(new CompressedFileIO(cipherIO, cfg));
+  ASSERT_EQ(dup->getSize(), reread->getSize());
+  compare(reread.get(), dup.get(), 0, dup->getSize());
+}
+
+TEST(IOTest, CompressedIO) { runWithAllCiphers(testCompressedIO); }
+
+#ifdef HAVE_ZLIB
+void testCompressedIOIndex(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<CompressedFileIO> test(new CompressedFileIO(base, cfg));
+
+  int chunkSize = test->blockSize();
+  MemBlock mb;
+  mb.allocate(2 * chunkSize);
+  memset(mb.data, 'x', 2 * chunkSize);
+
+  IORequest req;
+  req.offset = 0;
+  req.data = mb.data;
+  req.dataLen = 2 * chunkSize;
+  ASSERT_TRUE(test->write(req));
+
+  // the first chunk is compressed, the last one is stored as-is.
+  byte index[8];
+  req.data = index;
+  req.dataLen = sizeof(index);
+  ASSERT_EQ(8, base->read(req));
+  EXPECT_NE(0, index[0] | index[1] | index[2] | index[3]);
+  EXPECT_EQ(0, index[4] | index[5] | index[6] | index[7]);
+
+  req.data = mb.data;
+  req.dataLen = 2 * chunkSize;
+  memset(mb.data, 0, 2 * chunkSize);
+  ASSERT_EQ(2 * chunkSize, test->read(req));
+  for (int i = 0; i < 2 * chunkSize; ++i) ASSERT_EQ('x', mb.data[i]);
+}
+
+TEST(IOTest, CompressedIOIndex) {
+  runWithCipher("Null", 512, testCompressedIOIndex);
+}
+
+// Memory file which drops all writes after the first few, like a crash.
+class CrashingMemFileIO : public MemFileIO {
+ public:
+  CrashingMemFileIO() : MemFileIO(0), writesLeft(-1) {}
+  virtual bool write(const IORequest& req) {
+    if (writesLeft == 0) return false;
+    if (writesLeft > 0) --writesLeft;
+    return MemFileIO::write(req);
+  }
+  int writesLeft;
+};
+
+void testCompressedIOCrash(FSConfigPtr& cfg) {
+  shared_ptr<CrashingMemFileIO> base(new CrashingMemFileIO());
+  shared_ptr<CompressedFileIO> test(new CompressedFileIO(base, cfg));
+
+  // the first chunk doesn't compress, so it is stored as-is.
+  int chunkSize = test->blockSize();
+  MemBlock mb;
+  mb.allocate(2 * chunkSize);
+  cfg->cipher->pseudoRandomize(mb.data, 2 * chunkSize);
+
+  IORequest req;
+  req.offset = 0;
+  req.data = mb.data;
+  req.dataLen = 2 * chunkSize;
+  ASSERT_TRUE(test->write(req));
+
+  // rewrite it compressed, and crash before the index is updated.
+  memset(mb.data, 'x', chunkSize);
+  req.dataLen = chunkSize;
+  base->writesLeft = 2;
+  ASSERT_FALSE(test->write(req));
+
+  byte index[4];
+  req.data = index;
+  req.dataLen = sizeof(index);
+  ASSERT_EQ(4, base->read(req));
+  EXPECT_EQ(0xff, index[0] & index[1] & index[2] & index[3]);
+
+  // the chunk can't be read, but a full rewrite repairs it.
+  base->writesLeft = -1;
+  shared_ptr<CompressedFileIO> reread(new CompressedFileIO(base, cfg));
+  req.data = mb.data;
+  req.dataLen = chunkSize;
+  EXPECT_GT(0, reread->read(req));
+
+  memset(mb.data, 'y', chunkSize);
+  ASSERT_TRUE(reread->write(req));
+  memset(mb.data, 0, chunkSize);
+  ASSERT_EQ(chunkSize, reread->read(req));
+  for (int i = 0; i < chunkSize; ++i) ASSERT_EQ('y', mb.data[i]);
+}
+
+TEST(IOTest, CompressedIOCrash) {
+  runWithCipher("Null", 512, testCompressedIOCrash);
+}
+#endif
+
+void testWriteLogIO(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<MACFileIO> macIO(new MACFileIO(base, cfg));
+  shared_ptr<WriteLogFileIO> test(new WriteLogFileIO(macIO, cfg));
+  shared_ptr<MemFileIO> dup(new MemFileIO(0));
+  comparisonTest(cfg, test.get(), dup.get());
+
+  // scattered writes are held until flushed.
+  ASSERT_EQ(0, test->flush());
+  shared_ptr<MemFileIO> flushed = copyOf(base.get());
+  int bs = test->blockSize();
+  int size = test->getSize();
+  for (int i = 0; i < 20; ++i) {
+    int len = 1 + random() % bs;
+    writeRandom(cfg, test.get(), dup.get(), random() % (size - len), len);
+  }
+  compare(test.get(), dup.get(), 0, size);
+  compare(flushed.get(), base.get(), 0, flushed->getSize());
+
+  // as are writes past the end.
+  IORequest req;
+  byte buf[100];
+  memset(buf, 0x33, sizeof(buf));
+  req.offset = size + 3 * bs;
+  req.data = buf;
+  req.dataLen = sizeof(buf);
+  off_t baseSize = base->getSize();
+  ASSERT_TRUE(test->write(req));
+  memset(buf, 0x33, sizeof(buf));
+  ASSERT_TRUE(dup->write(req));
+  ASSERT_EQ(baseSize, base->getSize());
+  ASSERT_EQ(dup->getSize(), test->getSize());
+  compare(test.get(), dup.get(), 0, dup->getSize());
+
+  ASSERT_EQ(0, test->flush());
+  shared_ptr<MACFileIO> reread(new MACFileIO(base, cfg));
+  ASSERT_EQ(dup->getSize(), reread->getSize());
+  compare(reread.get(), dup.get(), 0, dup->getSize());
+
+  truncate(test.get(), dup.get(), 3 * bs + 7);
+  compare(test.get(), dup.get(), 0, dup->getSize());
+}
+
+TEST(IOTest, NullWriteLogIO) { runWithCipher("Null", 512, testWriteLogIO); }
+
+TEST(IOTest, WriteLogIO) { runWithAllCiphers(testWriteLogIO); }
+
 void testBasicCipherIO(FSConfigPtr& cfg) {
   shared_ptr<MemFileIO> base(new MemFileIO(0));
   shared_ptr<CipherFileIO> test(new CipherFileIO(base, cfg));
@@ -113,4 +612,525 @@ TEST(IOTest, NullCipherFileIO) { runWithCipher("Null", 512, testCipherIO); }
 
 TEST(IOTest, CipherFileIO) { runWithAllCiphers(testCipherIO); }
 
+// FileNode skips the block layers for the null cipher, which must leave
+// the stored data unchanged.
+void testNullCipherLayout(FSConfigPtr& cfg) {
+  ASSERT_TRUE(cfg->cipher->isNull());
+
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<CipherFileIO> test(new CipherFileIO(base, cfg));
+
+  byte buf[3 * 512 + 100];
+  for (unsigned int i = 0; i < sizeof(buf); ++i) buf[i] = i * 7;
+  IORequest req;
+  req.offset = 100;
+  req.data = buf;
+  req.dataLen = sizeof(buf);
+  ASSERT_TRUE(test->write(req));
+  ASSERT_EQ((off_t)(100 + sizeof(buf)), base->getSize());
+
+  byte raw[sizeof(buf) + 100];
+  req.offset = 0;
+  req.data = raw;
+  req.dataLen = sizeof(raw);
+  ASSERT_EQ((ssize_t)sizeof(raw), base->read(req));
+  for (int i = 0; i < 100; ++i) ASSERT_EQ(0, raw[i]);
+  ASSERT_EQ(0, memcmp(raw + 100, buf, sizeof(buf)));
+}
+
+TEST(IOTest, NullCipherLayout) {
+  runWithCipher("Null", 512, testNullCipherLayout);
+  ASSERT_FALSE(CipherV1::New("AES")->isNull());
+}
+
+// Builds a FileNode on a temporary file and checks which layer is on top,
+// and that data survives with header bytes of overhead on disk.
+void checkFileNodeStack(FSConfigPtr& cfg, const char* layer, int header) {
+  char path[] = "/tmp/encfs-node-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  {
+    FileNode node(NULL, cfg, "/file", path);
+    EXPECT_EQ(layer, node.interface().name());
+    ASSERT_GE(node.open(O_RDWR), 0);
+
+    byte buf[3 * 512 + 100];
+    for (unsigned int i = 0; i < sizeof(buf); ++i) buf[i] = i * 7;
+    byte tmp[sizeof(buf)];
+    memcpy(tmp, buf, sizeof(buf));
+    ASSERT_TRUE(node.write(100, tmp, sizeof(tmp)));
+
+    byte out[sizeof(buf)];
+    ASSERT_EQ((ssize_t)sizeof(out), node.read(100, out, sizeof(out)));
+    ASSERT_EQ(0, memcmp(buf, out, sizeof(buf)));
+    ASSERT_EQ(0, node.flush());
+  }
+
+  struct stat st;
+  ASSERT_EQ(0, stat(path, &st));
+  EXPECT_EQ((off_t)(100 + 3 * 512 + 100 + header), st.st_size);
+  unlink(path);
+}
+
+void testFileNodeStack(FSConfigPtr& cfg) {
+  checkFileNodeStack(cfg, "FileIO/Raw", 0);
+
+  // without mount options, as used by encfsctl.
+  cfg->opts.reset();
+  checkFileNodeStack(cfg, "FileIO/Raw", 0);
+
+  // a per-file header changes the stored data, so the cipher layer stays.
+  cfg->config->set_unique_iv(true);
+  checkFileNodeStack(cfg, "FileIO/Cipher", 8);
+}
+
+TEST(IOTest, FileNodeStack) { runWithCipher("Null", 512, testFileNodeStack); }
+
+TEST(ChangeRecordTest, MarkAndMerge) {
+  const off_t unit = 64 * 1024;
+  ChangeRecord record;
+  ASSERT_TRUE(record.empty());
+  record.mark(10, 1);
+  record.mark(3 * unit - 1, 2);
+  ASSERT_FALSE(record.empty());
+
+  std::vector<std::pair<off_t, off_t> > ranges = record.ranges(10 * unit);
+  ASSERT_EQ(2u, ranges.size());
+  EXPECT_EQ(0, ranges[0].first);
+  EXPECT_EQ(unit, ranges[0].second);
+  EXPECT_EQ(2 * unit, ranges[1].first);
+  EXPECT_EQ(4 * unit, ranges[1].second);
+
+  // ranges are limited to the file size.
+  ranges = record.ranges(3 * unit);
+  ASSERT_EQ(2u, ranges.size());
+  EXPECT_EQ(3 * unit, ranges[1].second);
+
+  ChangeRecord copy;
+  ASSERT_TRUE(copy.decode(record.encode()));
+  EXPECT_EQ(record.encode(), copy.encode());
+
+  // a large file makes the stored record coarser, but still covers the
+  // changes.
+  ChangeRecord big;
+  big.mark((off_t)4 << 30, 1);
+  copy.generation = 7;
+  copy.merge(big);
+  EXPECT_EQ(7u, copy.generation);
+  EXPECT_GT(copy.shift, record.shift);
+  EXPECT_LE(copy.encode().size(), 4096u);
+  ranges = copy.ranges((off_t)8 << 30);
+  ASSERT_EQ(2u, ranges.size());
+  EXPECT_EQ(0, ranges[0].first);
+  EXPECT_LE(ranges[1].first, (off_t)4 << 30);
+  EXPECT_GT(ranges[1].second, (off_t)4 << 30);
+
+  // marking far into a file coarsens the record before it grows.
+  ChangeRecord huge;
+  huge.mark(unit + 1, 20 * unit);
+  huge.mark((off_t)1 << 50, 1);
+  EXPECT_LE(huge.bits.size(), 2048u);
+  ranges = huge.ranges((off_t)1 << 51);
+  ASSERT_EQ(2u, ranges.size());
+  EXPECT_EQ(0, ranges[0].first);
+  EXPECT_GE(ranges[0].second, 21 * unit + 1);
+  EXPECT_LE(ranges[1].first, (off_t)1 << 50);
+  EXPECT_GT(ranges[1].second, (off_t)1 << 50);
+
+  // whole bytes of a long range are set, along with the partial ends.
+  ChangeRecord run;
+  run.mark(3 * unit, 30 * unit);
+  ranges = run.ranges(100 * unit);
+  ASSERT_EQ(1u, ranges.size());
+  EXPECT_EQ(3 * unit, ranges[0].first);
+  EXPECT_EQ(33 * unit, ranges[0].second);
+
+  // a reset clears only what was listed, up to the listed size.
+  ChangeRecord listed = run;
+  run.mark(40 * unit, 1);
+  run.unmark(listed, 20 * unit);
+  ranges = run.ranges(100 * unit);
+  ASSERT_EQ(2u, ranges.size());
+  EXPECT_EQ(20 * unit, ranges[0].first);
+  EXPECT_EQ(33 * unit, ranges[0].second);
+  EXPECT_EQ(40 * unit, ranges[1].first);
+}
+
+TEST(ChangeRecordTest, RawFileIO) {
+  char path[] = "/tmp/encfs-changes-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  ChangeRecord record;
+  int res = writeChangeRecord(-1, path, record);
+  if (res == -ENOTSUP || res == -EOPNOTSUPP) {
+    unlink(path);
+    return;  // no user attributes here.
+  }
+  ASSERT_EQ(0, res);
+
+  {
+    RawFileIO io(path);
+    io.setTrackChanges(true);
+    ASSERT_GE(io.open(O_RDWR), 0);
+
+    byte buf[100];
+    memset(buf, 0, sizeof(buf));
+    IORequest req;
+    req.offset = 200 * 1024;
+    req.data = buf;
+    req.dataLen = sizeof(buf);
+    ASSERT_TRUE(io.write(req));
+
+    // the unit is marked before the data is written, not only on flush.
+    ASSERT_EQ(0, readChangeRecord(-1, path, &record));
+    EXPECT_TRUE(record.covers(req.offset, req.dataLen));
+
+    // a unit which is already marked doesn't write the record again.
+    ASSERT_EQ(0, writeChangeRecord(-1, path, ChangeRecord()));
+    req.offset += 1000;
+    ASSERT_TRUE(io.write(req));
+    ASSERT_EQ(0, readChangeRecord(-1, path, &record));
+    EXPECT_TRUE(record.empty());
+
+    ASSERT_EQ(0, io.flush());
+  }
+
+  ASSERT_EQ(0, readChangeRecord(-1, path, &record));
+  std::vector<std::pair<off_t, off_t> > ranges = record.ranges(1 << 30);
+  ASSERT_EQ(1u, ranges.size());
+  EXPECT_LE(ranges[0].first, 200 * 1024);
+  EXPECT_GE(ranges[0].second, 200 * 1024 + 1100);
+  unlink(path);
+}
+
+TEST(TrashTest, DeferredDelete) {
+  char root[] = "/tmp/encfs-trash-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(root) != NULL);
+  std::string file = std::string(root) + "/file";
+  std::string trashDir = std::string(root) + "/" + TrashDirName;
+
+  int fd = open(file.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(100, write(fd, root, 100));
+  close(fd);
+
+  {
+    Trash trash(root);
+    // not running, so the caller has to unlink directly.
+    EXPECT_EQ(-ENOTSUP, trash.add(file));
+    ASSERT_TRUE(trash.start());
+    ASSERT_EQ(0, trash.add(file));
+    EXPECT_NE(0, access(file.c_str(), F_OK));
+
+    // wait for the reaper to empty the trash.
+    bool empty = false;
+    for (int i = 0; i < 100 && !empty; ++i) {
+      DIR *d = opendir(trashDir.c_str());
+      ASSERT_TRUE(d != NULL);
+      int entries = 0;
+      while (readdir(d) != NULL) ++entries;
+      closedir(d);
+      empty = (entries == 2);
+      if (!empty) usleep(50 * 1000);
+    }
+    EXPECT_TRUE(empty);
+  }
+
+  // leftovers from a crash are freed at mount time.
+  std::string leftover = trashDir + "/leftover";
+  fd = open(leftover.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  Trash::purge(root);
+  EXPECT_NE(0, access(trashDir.c_str(), F_OK));
+
+  EXPECT_EQ(0, rmdir(root));
+}
+
+void testTrashHidden(FSConfigPtr& cfg) {
+  char root[] = "/tmp/encfs-trash-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(root) != NULL);
+  std::string trashDir = std::string(root) + "/" + TrashDirName;
+  ASSERT_EQ(0, mkdir(trashDir.c_str(), 0700));
+  std::string file = std::string(root) + "/file";
+  int fd = open(file.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  // with plaintext names, the trash directory is a valid name.
+  cfg->nameCoding.reset(new NullNameIO());
+  DirNode dirNode(NULL, root, cfg);
+  std::string trash = std::string("/") + TrashDirName;
+
+  DirTraverse dt = dirNode.openDir("/");
+  ASSERT_TRUE(dt.valid());
+  std::list<std::string> names;
+  for (std::string name = dt.nextPlaintextName(); !name.empty();
+       name = dt.nextPlaintextName())
+    names.push_back(name);
+  EXPECT_EQ(1, std::count(names.begin(), names.end(), "file"));
+  EXPECT_EQ(0, std::count(names.begin(), names.end(), TrashDirName));
+
+  EXPECT_FALSE(dirNode.lookupNode(trash.c_str(), "test"));
+  EXPECT_FALSE(dirNode.lookupNode((trash + "/file").c_str(), "test"));
+  EXPECT_TRUE(dirNode.lookupNode("/file", "test"));
+  EXPECT_TRUE(dirNode.lookupNode((trash + "x").c_str(), "test"));
+
+  EXPECT_EQ(-EPERM, dirNode.mkdir((trash + "/dir").c_str(), 0700));
+  EXPECT_EQ(-EPERM, dirNode.link("/file", (trash + "/link").c_str()));
+  EXPECT_EQ(-EPERM, dirNode.rename("/file", trash.c_str()));
+  EXPECT_EQ(0, access(file.c_str(), F_OK));
+
+  EXPECT_EQ(0, unlink(file.c_str()));
+  EXPECT_EQ(0, rmdir(trashDir.c_str()));
+  EXPECT_EQ(0, rmdir(root));
+}
+
+TEST(TrashTest, HiddenFromNames) { runWithCipher("Null", 512, testTrashHidden); }
+
+void testSharedLinkNode(FSConfigPtr& cfg) {
+  char root[] = "/tmp/encfs-link-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(root) != NULL);
+  std::string file = std::string(root) + "/file";
+  std::string link = std::string(root) + "/link";
+  int fd = open(file.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_EQ(0, ::link(file.c_str(), link.c_str()));
+
+  cfg->nameCoding.reset(new NullNameIO());
+  EncFS_Context ctx;
+  DirNode dirNode(&ctx, root, cfg);
+
+  shared_ptr<FileNode> node = dirNode.lookupNode("/file", "test");
+  ASSERT_TRUE(node);
+  EXPECT_FALSE(ctx.hasOpenInodes());
+  EXPECT_NE(node, dirNode.lookupNode("/link", "test"));
+
+  // once the file is open, lookups through the other name find its node.
+  struct stat st;
+  ASSERT_EQ(0, lstat(file.c_str(), &st));
+  void *pl = ctx.putNode("/file", node, &st);
+  EXPECT_TRUE(ctx.hasOpenInodes());
+  EXPECT_EQ(node, dirNode.lookupNode("/link", "test"));
+
+  ctx.eraseNode("/file", pl);
+  EXPECT_FALSE(ctx.hasOpenInodes());
+  EXPECT_NE(node, dirNode.lookupNode("/link", "test"));
+
+  EXPECT_EQ(0, unlink(link.c_str()));
+  EXPECT_EQ(0, unlink(file.c_str()));
+  EXPECT_EQ(0, rmdir(root));
+}
+
+void testOpenTruncate(FSConfigPtr& cfg) {
+  char root[] = "/tmp/encfs-trunc-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(root) != NULL);
+  std::string file = std::string(root) + "/file";
+  int fd = open(file.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  cfg->config->set_unique_iv(true);
+  cfg->nameCoding.reset(new NullNameIO());
+  EncFS_Context ctx;
+  DirNode dirNode(&ctx, root, cfg);
+
+  int res = 0;
+  shared_ptr<FileNode> node =
+      dirNode.openNode("/file", "test", O_RDWR, &res);
+  ASSERT_TRUE(node) << res;
+  byte buf[1000];
+  memset(buf, 'x', sizeof(buf));
+  ASSERT_TRUE(node->write(0, buf, sizeof(buf)));
+  ASSERT_EQ((off_t)sizeof(buf), node->getSize());
+  node.reset();
+
+  // O_TRUNC is only acted on when opening for writing.
+  node = dirNode.openNode("/file", "test", O_RDONLY | O_TRUNC, &res);
+  ASSERT_TRUE(node) << res;
+  EXPECT_EQ((off_t)sizeof(buf), node->getSize());
+  node.reset();
+
+  node = dirNode.openNode("/file", "test", O_WRONLY | O_TRUNC, &res);
+  ASSERT_TRUE(node) << res;
+  EXPECT_EQ(0, node->getSize());
+  ASSERT_TRUE(node->write(0, buf, 10));
+  EXPECT_EQ(10, node->getSize());
+  node.reset();
+
+  EXPECT_EQ(0, unlink(file.c_str()));
+  EXPECT_EQ(0, rmdir(root));
+}
+
+TEST(DirNodeTest, OpenTruncate) {
+  runWithCipher("Null", 512, testOpenTruncate);
+}
+
+TEST(DirNodeTest, SharedLinkNode) {
+  runWithCipher("Null", 512, testSharedLinkNode);
+}
+
+void testMmapCipherIO(FSConfigPtr& cfg) {
+  char path[] = "/tmp/encfs-mmap-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  shared_ptr<MmapFileIO> base(new MmapFileIO(path));
+  ASSERT_GE(base->open(O_RDWR), 0);
+  shared_ptr<CipherFileIO> test(new CipherFileIO(base, cfg));
+
+  shared_ptr<MemFileIO> dup(new MemFileIO(0));
+  comparisonTest(cfg, test.get(), dup.get());
+
+  // shrink and grow again, reads must not use the stale mapping.
+  off_t size = test->getSize() / 2 + 7;
+  ASSERT_EQ(0, test->truncate(size));
+  ASSERT_EQ(0, dup->truncate(size));
+  compare(test.get(), dup.get(), 0, size);
+
+  ASSERT_EQ(0, test->truncate(size * 2));
+  ASSERT_EQ(0, dup->truncate(size * 2));
+  compare(test.get(), dup.get(), 0, size * 2);
+
+  unlink(path);
+}
+
+TEST(IOTest, MmapCipherFileIO) { runWithAllCiphers(testMmapCipherIO); }
+
+TEST(IOTest, MmapExternalTruncate) {
+  char path[] = "/tmp/encfs-mmap-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  MmapFileIO test(path);
+  ASSERT_GE(test.open(O_RDWR), 0);
+
+  byte buf[3 * 4096];
+  memset(buf, 0x5a, sizeof(buf));
+  IORequest req;
+  req.offset = 0;
+  req.data = buf;
+  req.dataLen = sizeof(buf);
+  ASSERT_TRUE(test.write(req));
+  ASSERT_EQ((ssize_t)sizeof(buf), test.read(req));
+
+  // shrink the file behind the mapping, the stale pages must not be touched.
+  ASSERT_EQ(0, ::truncate(path, 0));
+  req.offset = 4096;
+  req.dataLen = 100;
+  ASSERT_EQ(0, test.read(req));
+
+  unlink(path);
+}
+
+void testCipherIOTruncate(FSConfigPtr& cfg) {
+  cfg->config->set_unique_iv(true);
+
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<CipherFileIO> test(new CipherFileIO(base, cfg));
+  shared_ptr<MemFileIO> dup(new MemFileIO(0));
+
+  int bs = cfg->config->block_size();
+  byte buf[4096];
+  cfg->cipher->pseudoRandomize(buf, sizeof(buf));
+
+  // writes may encode in-place, so always write from a copy.
+  byte tmp[sizeof(buf)];
+  IORequest req;
+  req.data = tmp;
+  req.offset = 0;
+  req.dataLen = sizeof(buf);
+  memcpy(tmp, buf, sizeof(buf));
+  ASSERT_TRUE(test->write(req));
+  memcpy(tmp, buf, sizeof(buf));
+  ASSERT_TRUE(dup->write(req));
+
+  // Block boundary, then truncate-to-zero.  The header must survive both.
+  ASSERT_EQ(0, test->truncate(2 * bs));
+  ASSERT_EQ(0, dup->truncate(2 * bs));
+  ASSERT_EQ(2 * bs, test->getSize());
+  compare(test.get(), dup.get(), 0, 2 * bs);
+
+  ASSERT_EQ(0, test->truncate(0));
+  ASSERT_EQ(0, dup->truncate(0));
+  ASSERT_EQ(0, test->getSize());
+  ASSERT_EQ(8, base->getSize());
+
+  req.dataLen = bs + 17;
+  memcpy(tmp, buf, sizeof(buf));
+  ASSERT_TRUE(test->write(req));
+  memcpy(tmp, buf, sizeof(buf));
+  ASSERT_TRUE(dup->write(req));
+  compare(test.get(), dup.get(), 0, bs + 17);
+}
+
+TEST(IOTest, CipherFileIOTruncate) { runWithAllCiphers(testCipherIOTruncate); }
+
+void testCipherIOAlignedHeader(FSConfigPtr& cfg) {
+  cfg->config->set_unique_iv(true);
+  cfg->config->set_header_align(4096);
+
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<CipherFileIO> test(new CipherFileIO(base, cfg));
+  shared_ptr<MemFileIO> dup(new MemFileIO(0));
+  comparisonTest(cfg, test.get(), dup.get());
+
+  // data starts after the padded header.
+  ASSERT_EQ(4096 + test->getSize(), base->getSize());
+
+  // a new reader picks up the same file IV from the padded header.
+  shared_ptr<CipherFileIO> reread(new CipherFileIO(base, cfg));
+  compare(reread.get(), dup.get(), 0, dup->getSize());
+
+  // the header is kept whole when the file is emptied.
+  ASSERT_EQ(0, test->truncate(0));
+  ASSERT_EQ(4096, base->getSize());
+  ASSERT_EQ(0, test->getSize());
+}
+
+TEST(IOTest, CipherFileIOAlignedHeader) {
+  runWithAllCiphers(testCipherIOAlignedHeader);
+}
+
+void testCipherIOAllocate(FSConfigPtr& cfg) {
+  shared_ptr<MemFileIO> base(new MemFileIO(0));
+  shared_ptr<CipherFileIO> test(new CipherFileIO(base, cfg));
+  shared_ptr<MemFileIO> dup(new MemFileIO(0));
+
+  int bs = cfg->config->block_size();
+  byte buf[100];
+  cfg->cipher->pseudoRandomize(buf, sizeof(buf));
+
+  byte tmp[sizeof(buf)];
+  IORequest req;
+  req.data = tmp;
+  req.offset = 0;
+  req.dataLen = sizeof(buf);
+  memcpy(tmp, buf, sizeof(buf));
+  ASSERT_TRUE(test->write(req));
+  memcpy(tmp, buf, sizeof(buf));
+  ASSERT_TRUE(dup->write(req));
+
+  // Large enough to span several padding batches.
+  off_t length = 1100 * bs + 13;
+  ASSERT_EQ(0, test->allocate(0, length));
+  ASSERT_EQ(0, dup->allocate(0, length));
+  ASSERT_EQ(length, test->getSize());
+  compare(test.get(), dup.get(), 0, length);
+
+  // Allocating inside the file must not change it.
+  ASSERT_EQ(0, test->allocate(bs, bs));
+  ASSERT_EQ(length, test->getSize());
+  compare(test.get(), dup.get(), 0, 4 * bs);
+}
+
+TEST(IOTest, CipherFileIOAllocate) { runWithAllCiphers(testCipherIOAllocate); }
+
 }  // namespace
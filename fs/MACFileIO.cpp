@@ -47,6 +47,9 @@ namespace encfs {
 //
 static Interface MACFileIO_iface = makeInterface("FileIO/MAC", 2, 1, 0);
 
+// Most blocks checked with one batched MAC computation.
+static const int MaxBatchBlocks = 32;
+
 int dataBlockSize(const FSConfigPtr &cfg) {
   return cfg->config->block_size() - cfg->config->block_mac_bytes() -
          cfg->config->block_mac_rand_bytes();
@@ -137,44 +140,88 @@ off_t MACFileIO::getSize() const {
 }
 
 ssize_t MACFileIO::readOneBlock(const IORequest &req) const {
+  return readBlocks(req);
+}
+
+ssize_t MACFileIO::readBlocks(const IORequest &req) const {
   int headerSize = macBytes + randBytes;
+  int dataSize = blockSize();
+  int bs = dataSize + headerSize;
 
-  int bs = blockSize() + headerSize;
+  int maxBlocks = (req.dataLen + dataSize - 1) / dataSize;
+  if (maxBlocks > MaxBatchBlocks) maxBlocks = MaxBatchBlocks;
 
   MemBlock mb;
-  mb.allocate(bs);
-
-  IORequest tmp;
-  tmp.offset = locWithHeader(req.offset, bs, headerSize);
-  tmp.data = mb.data;
-  tmp.dataLen = headerSize + req.dataLen;
-
-  // get the data from the base FileIO layer
-  ssize_t readSize = base->read(tmp);
+  mb.allocate(maxBlocks * bs);
+
+  const byte *macData[MaxBatchBlocks];
+  int macLengths[MaxBatchBlocks];
+  int macBlocks[MaxBatchBlocks];
+  uint64_t macs[MaxBatchBlocks];
+
+  ssize_t result = 0;
+  while (result < req.dataLen) {
+    int len = req.dataLen - result;
+    int numBlocks = (len + dataSize - 1) / dataSize;
+    if (numBlocks > maxBlocks) {
+      numBlocks = maxBlocks;
+      len = numBlocks * dataSize;
+    }
 
-  // don't store zeros if configured for zero-block pass-through
-  bool skipBlock = true;
-  if (_allowHoles) {
-    for (int i = 0; i < readSize; ++i)
-      if (tmp.data[i] != 0) {
-        skipBlock = false;
+    // get the data for all the blocks from the base FileIO layer at once
+    IORequest tmp;
+    tmp.offset = locWithHeader(req.offset + result, bs, headerSize);
+    tmp.data = mb.data;
+    tmp.dataLen = len + numBlocks * headerSize;
+
+    ssize_t readSize = base->read(tmp);
+    if (readSize < 0) return (result > 0) ? result : readSize;
+
+    int count = 0;
+    int available = 0;
+    for (int i = 0; i < numBlocks; ++i) {
+      int blockLen = readSize - i * bs;
+      if (blockLen > bs) blockLen = bs;
+      if (blockLen <= headerSize) {
+        VLOG(1) << "readSize " << blockLen << " at offset "
+                << req.offset + result + i * dataSize;
         break;
       }
-  } else if (macBytes > 0)
-    skipBlock = false;
+      ++available;
+
+      // don't check zeros if configured for zero-block pass-through
+      const byte *block = tmp.data + i * bs;
+      bool skipBlock = true;
+      if (_allowHoles) {
+        for (int j = 0; j < blockLen; ++j)
+          if (block[j] != 0) {
+            skipBlock = false;
+            break;
+          }
+      } else if (macBytes > 0)
+        skipBlock = false;
+
+      if (!skipBlock) {
+        macData[count] = block + macBytes;
+        macLengths[count] = blockLen - macBytes;
+        macBlocks[count] = i;
+        ++count;
+      }
+    }
 
-  if (readSize > headerSize) {
-    if (!skipBlock) {
-      // At this point the data has been decoded.  So, compute the MAC of
-      // the block and check against the checksum stored in the header..
-      uint64_t mac = cipher->MAC_64(tmp.data + macBytes, readSize - macBytes);
+    // At this point the data has been decoded.  So, compute the MACs of the
+    // blocks together and check against the checksums stored in the headers.
+    if (count > 0) cipher->MAC_64(macData, macLengths, count, macs);
 
+    for (int k = 0; k < count; ++k) {
+      uint64_t mac = macs[k];
+      const byte *block = tmp.data + macBlocks[k] * bs;
       for (int i = 0; i < macBytes; ++i, mac >>= 8) {
         int test = mac & 0xff;
-        int stored = tmp.data[i];
+        int stored = block[i];
         if (test != stored) {
           // uh oh..
-          long blockNum = req.offset / bs;
+          long blockNum = (req.offset + result) / dataSize + macBlocks[k];
           LOG(WARNING) << "MAC comparison failure in block " << blockNum;
           if (!warnOnly) {
             throw Error(_("MAC comparison failure, refusing to read"));
@@ -185,14 +232,20 @@ ssize_t MACFileIO::readOneBlock(const IORequest &req) const {
     }
 
     // now copy the data to the output buffer
-    readSize -= headerSize;
-    memcpy(req.data, tmp.data + headerSize, readSize);
-  } else {
-    VLOG(1) << "readSize " << readSize << " at offset " << req.offset;
-    if (readSize > 0) readSize = 0;
+    for (int i = 0; i < available; ++i) {
+      int blockLen = readSize - i * bs;
+      if (blockLen > bs) blockLen = bs;
+      int copyLen = blockLen - headerSize;
+      if (copyLen > req.dataLen - result) copyLen = req.dataLen - result;
+
+      memcpy(req.data + result, tmp.data + i * bs + headerSize, copyLen);
+      result += copyLen;
+    }
+
+    if (available < numBlocks || readSize < tmp.dataLen) break;
   }
 
-  return readSize;
+  return result;
 }
 
 bool MACFileIO::writeOneBlock(const IORequest &req) {
@@ -244,6 +297,24 @@ int MACFileIO::truncate(off_t size) {
   return res;
 }
 
+int MACFileIO::allocate(off_t offset, off_t length) {
+  int headerSize = macBytes + randBytes;
+  int bs = blockSize() + headerSize;
+
+  int res = 0;
+  if (offset + length > getSize()) res = truncate(offset + length);
+
+  if (res == 0) {
+    off_t start = locWithHeader(offset, bs, headerSize);
+    off_t end = locWithHeader(offset + length, bs, headerSize);
+    res = base->allocate(start, end - start);
+  }
+
+  return res;
+}
+
+int MACFileIO::flush() { return base->flush(); }
+
 bool MACFileIO::isWritable() const { return base->isWritable(); }
 
 }  // namespace encfs
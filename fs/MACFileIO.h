@@ -48,12 +48,15 @@ class MACFileIO : public BlockFileIO {
   virtual off_t getSize() const;
 
   virtual int truncate(off_t size);
+  virtual int allocate(off_t offset, off_t length);
+  virtual int flush();
 
   virtual bool isWritable() const;
 
  private:
   virtual ssize_t readOneBlock(const IORequest &req) const;
   virtual bool writeOneBlock(const IORequest &req);
+  virtual ssize_t readBlocks(const IORequest &req) const;
 
   shared_ptr<FileIO> base;
   shared_ptr<CipherV1> cipher;
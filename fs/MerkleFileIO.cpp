@@ -0,0 +1,684 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fs/MerkleFileIO.h"
+#include "fs/fsconfig.pb.h"
+
+#include "base/Error.h"
+#include "base/i18n.h"
+#include "cipher/MemoryPool.h"
+#include "fs/FileUtils.h"
+
+#include <glog/logging.h>
+
+#include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace encfs {
+
+//
+// Layout of the next layer, in units of blockSize, with n = blockSize / 8
+// hashes per node block:
+//
+//   [root] [data 0] [node 0:0] [data 1] ... [data n-1] [node 1:0] [data n]
+//   [node 0:1] [data n+1] ...
+//
+// Node k:j (level k, index j) covers data blocks [j * n^(k+1), (j+1) * n^(k+1))
+// and holds the hashes of its n children, which are data blocks for level 0
+// and nodes of level k-1 above that.  It is placed right after its first
+// child, just before data block j * n^(k+1) + n^k, so it only exists once the
+// file reaches past its first child.  Until then its hash is the hash of its
+// first child.  Places never depend on the file size, so nothing moves when
+// the file grows.
+//
+// The root block holds the top hash and the file size of the last commit,
+// and the groups of n data blocks which may have changed since then, all
+// MACed together.  Every file has a root block, written when it is created or
+// truncated to nothing, so a file cut down to its root or less is detected.
+//
+static Interface MerkleFileIO_iface = makeInterface("FileIO/Merkle", 1, 0, 0);
+
+// Root block: top hash, size, MAC, number of group ranges, then the ranges.
+static const int RootHashOffset = 0;
+static const int RootSizeOffset = 8;
+static const int RootMacOffset = 16;
+static const int RootRangeCountOffset = 24;
+static const int RootRangesOffset = 32;
+
+static const uint64_t RootPosition = ~(uint64_t)0;
+
+// Largest span tracked, in blocks.  Files can't get anywhere near this.
+static const off_t MaxSpan = (off_t)1 << 62;
+
+// Nodes kept in memory.  The map is emptied when it fills up.
+static const unsigned int MaxCachedNodes = 64;
+
+// Written blocks held before the tree is updated without waiting for
+// flush().
+static const unsigned int MaxPendingBlocks = 4096;
+
+inline static off_t roundUpDivide(off_t numerator, int denominator) {
+  return (numerator + denominator - 1) / denominator;
+}
+
+static void putU64(unsigned char *buf, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    buf[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+static uint64_t getU64(const unsigned char *buf) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i) value = (value << 8) | buf[i];
+  return value;
+}
+
+MerkleFileIO::MerkleFileIO(const shared_ptr<FileIO> &_base,
+                           const FSConfigPtr &cfg)
+    : BlockFileIO(cfg->config->block_size(), cfg),
+      base(_base),
+      cipher(cfg->cipher),
+      hashesPerNode(cfg->config->block_size() / sizeof(uint64_t)),
+      warnOnly(cfg->opts->forceDecode),
+      rootLoaded(false),
+      topHash(0),
+      treeSize(0),
+      recovering(false) {
+  rAssert(hashesPerNode > 1);
+  rAssert(blockSize() % sizeof(uint64_t) == 0);
+  rAssert(blockSize() >= RootRangesOffset + 16);
+
+  // every block must have a hash, so zero blocks are always written out.
+  _allowHoles = false;
+}
+
+MerkleFileIO::~MerkleFileIO() {
+  try {
+    if (commit() < 0)
+      LOG(ERROR) << "hash tree of " << getFileName() << " not updated";
+  }
+  catch (Error &err) {
+    LOG(ERROR) << "error updating hash tree: " << err.what();
+  }
+}
+
+Interface MerkleFileIO::interface() const { return MerkleFileIO_iface; }
+
+int MerkleFileIO::open(int flags) { return base->open(flags); }
+
+void MerkleFileIO::setFileName(const char *fileName) {
+  base->setFileName(fileName);
+}
+
+const char *MerkleFileIO::getFileName() const { return base->getFileName(); }
+
+bool MerkleFileIO::setIV(uint64_t iv) { return base->setIV(iv); }
+
+// Number of data blocks covered by a node of the given level, where level
+// -1 is a data block.
+off_t MerkleFileIO::span(int level) const {
+  off_t result = 1;
+  for (int i = 0; i <= level && result < MaxSpan; ++i) result *= hashesPerNode;
+  return (result < MaxSpan) ? result : MaxSpan;
+}
+
+bool MerkleFileIO::hasNode(int level, off_t index, off_t blocks) const {
+  off_t first = index * span(level);
+  return first < blocks && blocks - first > span(level - 1);
+}
+
+// Number of node levels for a file of the given number of blocks.  The hash
+// of a single block is stored in the root directly.
+int MerkleFileIO::depth(off_t blocks) const {
+  if (blocks <= 1) return 0;
+
+  int levels = 1;
+  while (span(levels - 1) < blocks) ++levels;
+  return levels;
+}
+
+off_t MerkleFileIO::nodesBefore(off_t blockNum) const {
+  off_t count = 0;
+  for (int level = 0; span(level - 1) <= blockNum; ++level)
+    count += (blockNum - span(level - 1)) / span(level) + 1;
+  return count;
+}
+
+off_t MerkleFileIO::dataOffset(off_t blockNum) const {
+  return (1 + blockNum + nodesBefore(blockNum)) * blockSize();
+}
+
+off_t MerkleFileIO::nodeOffset(int level, off_t index) const {
+  return dataOffset(index * span(level) + span(level - 1)) - blockSize();
+}
+
+// Size of the next layer for a file of the given size.
+off_t MerkleFileIO::rawSize(off_t size) const {
+  if (size == 0) return 0;
+
+  off_t lastBlock = roundUpDivide(size, blockSize()) - 1;
+  return dataOffset(lastBlock) + size - lastBlock * blockSize();
+}
+
+// Size of the file, given the size of the next layer.
+off_t MerkleFileIO::dataSize(off_t rawSize) const {
+  int bs = blockSize();
+  if (rawSize <= bs) return 0;
+
+  // find the last data block before the end.
+  off_t lastUnit = roundUpDivide(rawSize - bs, bs) - 1;
+  off_t low = 0;
+  off_t high = lastUnit;
+  while (low < high) {
+    off_t mid = low + (high - low + 1) / 2;
+    if (mid + nodesBefore(mid) <= lastUnit)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+
+  if (low + nodesBefore(low) < lastUnit) return (low + 1) * bs;
+  return low * bs + (rawSize - bs - lastUnit * bs);
+}
+
+int MerkleFileIO::getAttr(struct stat *stbuf) const {
+  int res = base->getAttr(stbuf);
+
+  if (res == 0 && S_ISREG(stbuf->st_mode))
+    stbuf->st_size = dataSize(stbuf->st_size);
+
+  return res;
+}
+
+off_t MerkleFileIO::getSize() const { return dataSize(base->getSize()); }
+
+void MerkleFileIO::integrityFailure(const char *what, off_t where) const {
+  LOG(WARNING) << "Integrity check failure in " << what << " " << where
+               << " of " << getFileName();
+  if (!warnOnly) throw Error(_("Integrity check failure, refusing to read"));
+}
+
+uint64_t MerkleFileIO::nodeHash(int level, off_t index,
+                                const unsigned char *data) const {
+  uint64_t position = ((uint64_t)(level + 1) << 56) | index;
+  return cipher->MAC_64(data, blockSize(), &position);
+}
+
+static bool covers(const std::vector<std::pair<off_t, off_t> > &ranges,
+                   off_t first, off_t end) {
+  for (size_t i = 0; i < ranges.size(); ++i)
+    if (ranges[i].first <= first && end <= ranges[i].second) return true;
+  return false;
+}
+
+void MerkleFileIO::loadRoot() const {
+  if (rootLoaded) return;
+  rootLoaded = true;
+
+  off_t size = getSize();
+  if (base->getSize() == 0) {
+    // only with warnOnly: carry on as an empty file.
+    integrityFailure("missing root block of size", size);
+    return;
+  }
+
+  int bs = blockSize();
+  MemBlock mb;
+  mb.allocate(bs);
+  IORequest req;
+  req.offset = 0;
+  req.data = mb.data;
+  req.dataLen = bs;
+  ssize_t readSize = base->read(req);
+
+  bool valid = (readSize == bs);
+  GroupRanges groups;
+  if (valid) {
+    uint64_t mac = getU64(mb.data + RootMacOffset);
+    memset(mb.data + RootMacOffset, 0, 8);
+    uint64_t position = RootPosition;
+    off_t ranges = getU64(mb.data + RootRangeCountOffset);
+    valid = (mac == cipher->MAC_64(mb.data, bs, &position)) && ranges >= 0 &&
+            ranges <= (bs - RootRangesOffset) / 16;
+
+    for (off_t i = 0; valid && i < ranges; ++i) {
+      const unsigned char *p = mb.data + RootRangesOffset + i * 16;
+      groups.push_back(std::make_pair(getU64(p), getU64(p + 8)));
+    }
+  }
+
+  if (!valid) {
+    integrityFailure("root block of size", size);
+
+    // only with warnOnly: hash the whole file again.
+    groups.assign(1, std::make_pair(0, roundUpDivide(size, bs * hashesPerNode)));
+    recover(groups, 0);
+    return;
+  }
+
+  topHash = getU64(mb.data + RootHashOffset);
+  treeSize = getU64(mb.data + RootSizeOffset);
+  if (groups.empty()) {
+    if (treeSize != size) integrityFailure("root block of size", size);
+    return;
+  }
+
+  // a size change must have been announced by the root.
+  off_t oldBlocks = roundUpDivide(treeSize, bs);
+  off_t newBlocks = roundUpDivide(size, bs);
+  off_t first = std::min(oldBlocks, newBlocks);
+  off_t end = std::max(oldBlocks, newBlocks);
+  if (first > 0) --first;
+  if (first < end &&
+      !covers(groups, first / hashesPerNode,
+              (end - 1) / hashesPerNode + 1)) {
+    integrityFailure("root block of size", size);
+  }
+
+  recover(groups, treeSize);
+}
+
+// Blocks of the changing groups can't be checked, as they may have been
+// written after the last commit.  Nodes above them may be part way through an
+// update, so they are used without being checked.
+//
+// Unless a repair is asked for with warnOnly, the groups are kept as damaged:
+// reading their blocks fails until they are written again, and they stay
+// marked in the root.  With warnOnly, their blocks are hashed again and the
+// tree is brought up to date with them.
+void MerkleFileIO::recover(const GroupRanges &groups, off_t oldSize) const {
+  int bs = blockSize();
+  off_t blocks = roundUpDivide(getSize(), bs);
+
+  treeSize = oldSize;
+  changing = groups;
+  recovering = true;
+
+  if (!warnOnly) {
+    damaged = groups;
+    LOG(ERROR) << "hash tree of " << getFileName()
+               << " wasn't updated after its last change, mount with "
+                  "--forcedecode to repair it";
+    return;
+  }
+
+  MemBlock mb;
+  mb.allocate(bs);
+  off_t count = 0;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    off_t end = std::min(groups[i].second * hashesPerNode, blocks);
+    for (off_t b = groups[i].first * hashesPerNode; b < end; ++b, ++count) {
+      IORequest req;
+      req.offset = dataOffset(b);
+      req.data = mb.data;
+      req.dataLen = bs;
+      ssize_t readSize = base->read(req);
+      if (readSize <= 0) continue;
+
+      uint64_t position = b;
+      pending[b] = cipher->MAC_64(mb.data, readSize, &position);
+    }
+  }
+  memset(mb.data, 0, bs);
+
+  LOG(WARNING) << "hash tree of " << getFileName()
+               << " wasn't updated after its last change, hashed " << count
+               << " blocks again";
+
+  MerkleFileIO *self = const_cast<MerkleFileIO *>(this);
+  if (!base->isWritable() && base->open(O_RDWR) < 0) {
+    LOG(WARNING) << "unable to update the hash tree of " << getFileName()
+                 << ", changed parts can't be checked until it is written";
+    return;
+  }
+  self->commit();
+}
+
+bool MerkleFileIO::writeRoot() {
+  int bs = blockSize();
+  MemBlock mb;
+  mb.allocate(bs);
+  memset(mb.data, 0, bs);
+
+  putU64(mb.data + RootHashOffset, topHash);
+  putU64(mb.data + RootSizeOffset, treeSize);
+  putU64(mb.data + RootRangeCountOffset, changing.size());
+  for (size_t i = 0; i < changing.size(); ++i) {
+    unsigned char *p = mb.data + RootRangesOffset + i * 16;
+    putU64(p, changing[i].first);
+    putU64(p + 8, changing[i].second);
+  }
+  uint64_t position = RootPosition;
+  putU64(mb.data + RootMacOffset, cipher->MAC_64(mb.data, bs, &position));
+
+  IORequest req;
+  req.offset = 0;
+  req.data = mb.data;
+  req.dataLen = bs;
+  return base->write(req);
+}
+
+// Mark the groups holding [firstBlock, endBlock) as changing in the root,
+// before any of their blocks are written.  The root has room for a limited
+// number of ranges, so the closest ones are merged when it fills up.
+bool MerkleFileIO::openGroups(off_t firstBlock, off_t endBlock) {
+  off_t first = firstBlock / hashesPerNode;
+  off_t end = (endBlock - 1) / hashesPerNode + 1;
+  if (covers(changing, first, end)) return true;
+
+  changing.push_back(std::make_pair(first, end));
+  std::sort(changing.begin(), changing.end());
+
+  GroupRanges merged;
+  for (size_t i = 0; i < changing.size(); ++i) {
+    if (!merged.empty() && changing[i].first <= merged.back().second)
+      merged.back().second = std::max(merged.back().second, changing[i].second);
+    else
+      merged.push_back(changing[i]);
+  }
+
+  size_t maxRanges = (blockSize() - RootRangesOffset) / 16;
+  while (merged.size() > maxRanges) {
+    size_t closest = 0;
+    for (size_t i = 1; i + 1 < merged.size(); ++i)
+      if (merged[i + 1].first - merged[i].second <
+          merged[closest + 1].first - merged[closest].second)
+        closest = i;
+    merged[closest].second = merged[closest + 1].second;
+    merged.erase(merged.begin() + closest + 1);
+  }
+  changing.swap(merged);
+
+  return writeRoot();
+}
+
+// A node of the committed tree, checked against its hash unless verify is
+// false.
+const MerkleFileIO::Node &MerkleFileIO::loadNode(int level, off_t index,
+                                                 uint64_t hash,
+                                                 bool verify) const {
+  NodeKey key(level, index);
+  std::map<NodeKey, Node>::const_iterator it = nodes.find(key);
+  if (it != nodes.end()) return it->second;
+
+  int bs = blockSize();
+  MemBlock mb;
+  mb.allocate(bs);
+  IORequest req;
+  req.offset = nodeOffset(level, index);
+  req.data = mb.data;
+  req.dataLen = bs;
+  ssize_t readSize = base->read(req);
+  if (readSize < 0) readSize = 0;
+  memset(mb.data + readSize, 0, bs - readSize);
+
+  if (verify && nodeHash(level, index, mb.data) != hash)
+    integrityFailure("hash node", index);
+
+  if (nodes.size() >= MaxCachedNodes) nodes.clear();
+  Node &node = nodes[key];
+  node.resize(hashesPerNode);
+  for (int i = 0; i < hashesPerNode; ++i) node[i] = getU64(mb.data + i * 8);
+  return node;
+}
+
+// Hash of subtree level:0 in the committed tree.
+uint64_t MerkleFileIO::subtreeHash(int level) const {
+  off_t blocks = roundUpDivide(treeSize, blockSize());
+  uint64_t hash = topHash;
+  for (int k = depth(blocks) - 1; k > level; --k)
+    if (hasNode(k, 0, blocks)) hash = loadNode(k, 0, hash, !recovering)[0];
+  return hash;
+}
+
+// New hash of subtree level:index, given its hash in the committed tree.
+// Nodes of changed subtrees are written out on the way.
+uint64_t MerkleFileIO::update(int level, off_t index, uint64_t oldHash,
+                              off_t oldBlocks, off_t newBlocks) {
+  if (level < 0) {
+    std::map<off_t, uint64_t>::const_iterator it = pending.find(index);
+    if (it != pending.end()) return it->second;
+    LOG_IF(ERROR, index >= oldBlocks) << "no hash for block " << index;
+    return oldHash;
+  }
+
+  off_t first = index * span(level);
+  off_t end = first + span(level);
+  off_t oldCount = std::max((off_t)0, std::min(oldBlocks, end) - first);
+  off_t newCount = std::max((off_t)0, std::min(newBlocks, end) - first);
+  std::map<off_t, uint64_t>::const_iterator it = pending.lower_bound(first);
+  if (oldCount == newCount && (it == pending.end() || it->first >= end))
+    return oldHash;
+
+  Node old(hashesPerNode, 0);
+  if (hasNode(level, index, oldBlocks))
+    old = loadNode(level, index, oldHash, !recovering);
+  else if (oldCount > 0)
+    old[0] = oldHash;
+
+  off_t child = index * hashesPerNode;
+  if (!hasNode(level, index, newBlocks))
+    return update(level - 1, child, old[0], oldBlocks, newBlocks);
+
+  Node node(hashesPerNode, 0);
+  for (int i = 0; i < hashesPerNode; ++i) {
+    if ((child + i) * span(level - 1) >= newBlocks) break;
+    node[i] = update(level - 1, child + i, old[i], oldBlocks, newBlocks);
+  }
+
+  int bs = blockSize();
+  MemBlock mb;
+  mb.allocate(bs);
+  memset(mb.data, 0, bs);
+  for (int i = 0; i < hashesPerNode; ++i) putU64(mb.data + i * 8, node[i]);
+  uint64_t hash = nodeHash(level, index, mb.data);
+
+  IORequest req;
+  req.offset = nodeOffset(level, index);
+  req.data = mb.data;
+  req.dataLen = bs;
+  if (!base->write(req)) throw Error("failed to write hash node");
+
+  if (nodes.size() >= MaxCachedNodes) nodes.clear();
+  nodes[NodeKey(level, index)].swap(node);
+  return hash;
+}
+
+// Bring the tree up to date with the written blocks and the file size, and
+// write a root without changing groups.
+int MerkleFileIO::commit() {
+  if (!rootLoaded) return 0;
+
+  off_t size = getSize();
+  if (pending.empty() && changing == damaged && size == treeSize) return 0;
+
+  // after recovering a read-only file, the tree stays in memory.
+  if (recovering && !base->isWritable()) return 0;
+
+  off_t oldBlocks = roundUpDivide(treeSize, blockSize());
+  off_t newBlocks = roundUpDivide(size, blockSize());
+  VLOG(1) << "updating hash tree of " << getFileName() << " with "
+          << pending.size() << " blocks";
+
+  uint64_t oldTop = topHash;
+  off_t oldSize = treeSize;
+  try {
+    uint64_t top = 0;
+    if (newBlocks > 0) {
+      int levels = depth(newBlocks);
+      top = update(levels - 1, 0, subtreeHash(levels - 1), oldBlocks,
+                   newBlocks);
+    }
+
+    topHash = top;
+    treeSize = size;
+    // damaged groups stay marked until they are repaired.
+    GroupRanges oldChanging = damaged;
+    changing.swap(oldChanging);
+    if (!writeRoot()) {
+      changing.swap(oldChanging);
+      throw Error("failed to write root block");
+    }
+  }
+  catch (Error &err) {
+    LOG(ERROR) << "error updating hash tree of " << getFileName() << ": "
+               << err.what();
+    // the nodes on disk may be part way through the update.
+    topHash = oldTop;
+    treeSize = oldSize;
+    nodes.clear();
+    recovering = true;
+    return -EIO;
+  }
+
+  pending.clear();
+  recovering = false;
+  return 0;
+}
+
+ssize_t MerkleFileIO::readOneBlock(const IORequest &req) const {
+  loadRoot();
+
+  off_t blockNum = req.offset / blockSize();
+
+  IORequest tmp = req;
+  tmp.offset = dataOffset(blockNum);
+  ssize_t readSize = base->read(tmp);
+  if (readSize <= 0) return readSize;
+
+  uint64_t position = blockNum;
+  uint64_t mac = cipher->MAC_64(req.data, readSize, &position);
+
+  std::map<off_t, uint64_t>::const_iterator it = pending.find(blockNum);
+  if (it != pending.end()) {
+    if (mac != it->second) integrityFailure("block", blockNum);
+    return readSize;
+  }
+
+  off_t group = blockNum / hashesPerNode;
+  if (covers(damaged, group, group + 1)) {
+    integrityFailure("block of an interrupted update", blockNum);
+    return readSize;
+  }
+
+  off_t blocks = roundUpDivide(treeSize, blockSize());
+  if (blockNum >= blocks) {
+    integrityFailure("unlisted block", blockNum);
+    return readSize;
+  }
+
+  // follow the path from the root down to the block.
+  uint64_t hash = topHash;
+  for (int level = depth(blocks) - 1; level >= 0; --level) {
+    off_t index = blockNum / span(level);
+    if (hasNode(level, index, blocks)) {
+      const Node &node = loadNode(level, index, hash, !recovering);
+      hash = node[(blockNum / span(level - 1)) % hashesPerNode];
+    }
+  }
+
+  if (mac != hash) integrityFailure("block", blockNum);
+
+  return readSize;
+}
+
+bool MerkleFileIO::writeOneBlock(const IORequest &req) {
+  loadRoot();
+
+  off_t blockNum = req.offset / blockSize();
+
+  // hash the data before passing it on, as it may be encoded in place.
+  uint64_t position = blockNum;
+  uint64_t mac = cipher->MAC_64(req.data, req.dataLen, &position);
+
+  if (!openGroups(blockNum, blockNum + 1)) return false;
+
+  IORequest tmp = req;
+  tmp.offset = dataOffset(blockNum);
+  if (!base->write(tmp)) return false;
+
+  pending[blockNum] = mac;
+  if (pending.size() >= MaxPendingBlocks) return commit() == 0;
+  return true;
+}
+
+int MerkleFileIO::truncate(off_t size) {
+  int bs = blockSize();
+  if (size == 0) {
+    int res = blockTruncate(0, 0);
+    if (res == 0) res = base->truncate(0);
+    if (res != 0) return res;
+
+    // nothing is left of the tree, but the root stays to record that.
+    rootLoaded = true;
+    topHash = 0;
+    treeSize = 0;
+    changing.clear();
+    damaged.clear();
+    pending.clear();
+    nodes.clear();
+    recovering = false;
+    return writeRoot() ? 0 : -EIO;
+  }
+
+  loadRoot();
+
+  off_t oldSize = getSize();
+  off_t blocks = roundUpDivide(size, bs);
+
+  // the blocks which go away and the new last block change.
+  if (size > 0 && size < oldSize &&
+      !openGroups(blocks - 1, roundUpDivide(oldSize, bs)))
+    return -EIO;
+
+  int res = blockTruncate(size, 0);
+  if (res == 0) res = base->truncate(rawSize(size));
+  if (res != 0) return res;
+
+  if (size < oldSize) {
+    pending.erase(pending.lower_bound(blocks), pending.end());
+    nodes.clear();
+
+    // damaged groups past the new end are gone.
+    off_t groups = roundUpDivide(blocks, hashesPerNode);
+    GroupRanges kept;
+    for (size_t i = 0; i < damaged.size(); ++i)
+      if (damaged[i].first < groups)
+        kept.push_back(std::make_pair(damaged[i].first,
+                                      std::min(damaged[i].second, groups)));
+    damaged.swap(kept);
+  }
+
+  return commit();
+}
+
+int MerkleFileIO::flush() {
+  int res = commit();
+  if (res < 0) return res;
+
+  return base->flush();
+}
+
+bool MerkleFileIO::isWritable() const { return base->isWritable(); }
+
+}  // namespace encfs
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MerkleFileIO_incl_
+#define _MerkleFileIO_incl_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "cipher/CipherV1.h"
+#include "fs/BlockFileIO.h"
+
+namespace encfs {
+
+/*
+    Integrity checking with a hash tree, as an alternative to MACFileIO.
+
+    Data blocks are stored whole, so they keep the configured block size.  The
+    8 byte MACs of the data blocks are kept in node blocks, each holding the
+    hashes of (blockSize / 8) blocks or nodes of the level below, and a root
+    block at the start of the file holds the top hash of the tree together
+    with the file size.  Everything is MACed together with its position, so
+    reordering or truncating the file is detected as well as modified data.
+    Node blocks have fixed places between the data blocks, so a file grows
+    without anything being moved.
+
+    A read loads and checks only the nodes on the path from its blocks to the
+    root, and keeps a few of them for the next read.  The MACs of written
+    blocks are held in memory, and the nodes above them are written once, on
+    flush() or when enough changes have built up.
+
+    Before data is written, the root is marked with the groups of blocks which
+    may change until the next flush.  If the file wasn't flushed, for example
+    after a crash, then reads of those blocks fail until they are written
+    again, and the rest of the file is still checked against the tree.
+
+    If warnOnly is enabled (forceDecode), then a failure only results in a
+    warning, and the data is still made available.  Blocks of an interrupted
+    update are then hashed again, which repairs the tree.
+*/
+class MerkleFileIO : public BlockFileIO {
+ public:
+  MerkleFileIO(const shared_ptr<FileIO> &base, const FSConfigPtr &cfg);
+  virtual ~MerkleFileIO();
+
+  virtual Interface interface() const;
+
+  virtual void setFileName(const char *fileName);
+  virtual const char *getFileName() const;
+  virtual bool setIV(uint64_t iv);
+
+  virtual int open(int flags);
+  virtual int getAttr(struct stat *stbuf) const;
+  virtual off_t getSize() const;
+
+  virtual int truncate(off_t size);
+  virtual int flush();
+
+  virtual bool isWritable() const;
+
+ private:
+  virtual ssize_t readOneBlock(const IORequest &req) const;
+  virtual bool writeOneBlock(const IORequest &req);
+
+  typedef std::pair<int, off_t> NodeKey;  // level, index in level
+  typedef std::vector<uint64_t> Node;
+  typedef std::vector<std::pair<off_t, off_t> > GroupRanges;
+
+  off_t span(int level) const;
+  bool hasNode(int level, off_t index, off_t blocks) const;
+  int depth(off_t blocks) const;
+
+  off_t nodesBefore(off_t blockNum) const;
+  off_t dataOffset(off_t blockNum) const;
+  off_t nodeOffset(int level, off_t index) const;
+  off_t rawSize(off_t size) const;
+  off_t dataSize(off_t rawSize) const;
+
+  void loadRoot() const;
+  void recover(const GroupRanges &groups, off_t oldSize) const;
+  bool writeRoot();
+  bool openGroups(off_t firstBlock, off_t endBlock);
+
+  const Node &loadNode(int level, off_t index, uint64_t hash,
+                       bool verify) const;
+  uint64_t nodeHash(int level, off_t index, const unsigned char *data) const;
+  uint64_t subtreeHash(int level) const;
+  uint64_t update(int level, off_t index, uint64_t oldHash, off_t oldBlocks,
+                  off_t newBlocks);
+  int commit();
+
+  void integrityFailure(const char *what, off_t where) const;
+
+  shared_ptr<FileIO> base;
+  shared_ptr<CipherV1> cipher;
+  int hashesPerNode;
+  bool warnOnly;
+
+  // state of the tree as of the last commit, read from the root block.
+  mutable bool rootLoaded;
+  mutable uint64_t topHash;
+  mutable off_t treeSize;
+
+  // groups of hashesPerNode blocks which may differ from the tree.
+  mutable GroupRanges changing;
+
+  // groups left changing by an interrupted update, which can't be read.
+  mutable GroupRanges damaged;
+
+  // MACs of blocks written since the last commit.
+  mutable std::map<off_t, uint64_t> pending;
+
+  // checked nodes of the committed tree.
+  mutable std::map<NodeKey, Node> nodes;
+
+  // set while unchecked nodes are rebuilt after an interrupted update.
+  mutable bool recovering;
+};
+
+}  // namespace encfs
+
+#endif
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/config.h"
+#include "base/Error.h"
+#include "fs/MmapFileIO.h"
+
+#include <glog/logging.h>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <cstring>
+#include <cerrno>
+
+namespace encfs {
+
+namespace {
+
+// Set while this thread copies out of a mapping.  Touching a mapped page
+// which is no longer backed by the file (truncated behind our back, or a
+// media error) raises SIGBUS, which then jumps back into read().  volatile
+// so the compiler keeps the stores around the memcpy.
+thread_local sigjmp_buf *volatile faultJump = NULL;
+
+struct sigaction oldBusAction;
+
+void busHandler(int sig, siginfo_t *info, void *context) {
+  if (faultJump != NULL) siglongjmp(*faultJump, 1);
+
+  // not one of ours, hand it on.
+  if (oldBusAction.sa_flags & SA_SIGINFO) {
+    oldBusAction.sa_sigaction(sig, info, context);
+  } else if (oldBusAction.sa_handler != SIG_DFL &&
+             oldBusAction.sa_handler != SIG_IGN) {
+    oldBusAction.sa_handler(sig);
+  } else {
+    // restore the default action, the fault repeats on return.
+    sigaction(SIGBUS, &oldBusAction, NULL);
+  }
+}
+
+bool installBusHandler() {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = busHandler;
+  sigemptyset(&sa.sa_mask);
+  // SA_NODEFER so that SIGBUS isn't left blocked after the jump.
+  sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+  return sigaction(SIGBUS, &sa, &oldBusAction) == 0;
+}
+
+}  // namespace
+
+MmapFileIO::MmapFileIO(const std::string &fileName)
+    : RawFileIO(fileName), map(NULL), mapLen(0), mapAdvice(0) {}
+
+MmapFileIO::~MmapFileIO() { unmap(); }
+
+void MmapFileIO::unmap() const {
+  if (map != NULL) ::munmap(map, mapLen);
+  map = NULL;
+  mapLen = 0;
+  mapAdvice = 0;
+}
+
+bool MmapFileIO::remap(off_t size) const {
+  unmap();
+  if (size <= 0 || fd < 0) return false;
+
+  void *addr = ::mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    // eg. no address space left on 32 bit systems, fall back to pread.
+    VLOG(1) << "mmap of " << name << " failed: " << strerror(errno);
+    return false;
+  }
+
+  map = addr;
+  mapLen = size;
+  return true;
+}
+
+ssize_t MmapFileIO::read(const IORequest &req) const {
+  rAssert(fd >= 0);
+
+  // the file may have grown since it was mapped.
+  if (req.offset + (off_t)req.dataLen > mapLen) {
+    off_t size = getSize();
+    if (size > mapLen) remap(size);
+  }
+
+  static bool guarded = installBusHandler();
+  if (!guarded || map == NULL || req.offset >= mapLen)
+    return RawFileIO::read(req);
+
+  VLOG(2) << "Read " << req.dataLen << " bytes from offset " << req.offset
+          << " (mapped)";
+  size_t len = req.dataLen;
+  if (req.offset + (off_t)len > mapLen) len = mapLen - req.offset;
+
+  sigjmp_buf jump;
+  if (sigsetjmp(jump, 0) != 0) {
+    faultJump = NULL;
+    // pread reports a short read or EIO where the mapping faulted.
+    LOG(WARNING) << "fault reading mapping of " << name
+                 << ", falling back to pread";
+    unmap();
+    return RawFileIO::read(req);
+  }
+  faultJump = &jump;
+  memcpy(req.data, (unsigned char *)map + req.offset, len);
+  faultJump = NULL;
+
+  adviseRead(req);
+#ifdef HAVE_POSIX_FADVISE
+  // pass the detected access pattern on to the page fault readahead too.
+  if (advice != mapAdvice) {
+    int madv = MADV_NORMAL;
+    if (advice == POSIX_FADV_SEQUENTIAL)
+      madv = MADV_SEQUENTIAL;
+    else if (advice == POSIX_FADV_RANDOM)
+      madv = MADV_RANDOM;
+    ::madvise(map, mapLen, madv);
+    mapAdvice = advice;
+  }
+#endif
+
+  return len;
+}
+
+int MmapFileIO::truncate(off_t size) {
+  // touching mapped pages beyond the end of file raises SIGBUS, so drop the
+  // mapping before shrinking.  It is recreated on the next read.
+  if (size < mapLen) unmap();
+
+  return RawFileIO::truncate(size);
+}
+
+}  // namespace encfs
@@ -0,0 +1,61 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MmapFileIO_incl_
+#define _MmapFileIO_incl_
+
+#include "fs/RawFileIO.h"
+
+#include <string>
+
+namespace encfs {
+
+/*
+    RawFileIO variant which serves reads from a shared read-only mapping of the
+    backing file, so that reading data which is already in the page cache is a
+    memory copy rather than a system call.  Writes still go through pwrite,
+    which is coherent with the mapping.
+
+    The mapping is grown when the file grows and dropped when it shrinks.  If
+    the backing file is truncated behind our back, or the disk returns an
+    error, the copy faults with SIGBUS.  A handler catches that, and the read
+    is retried with pread.
+*/
+class MmapFileIO : public RawFileIO {
+ public:
+  MmapFileIO(const std::string &fileName);
+  virtual ~MmapFileIO();
+
+  virtual ssize_t read(const IORequest &req) const;
+
+  virtual int truncate(off_t size);
+
+ private:
+  bool remap(off_t size) const;
+  void unmap() const;
+
+  mutable void *map;
+  mutable off_t mapLen;
+  mutable int mapAdvice;
+};
+
+}  // namespace encfs
+
+#endif
@@ -34,6 +34,7 @@
 #include "fs/BlockNameIO.h"
 #include "fs/StreamNameIO.h"
 #include "fs/NullNameIO.h"
+#include "fs/SivNameIO.h"
 
 using std::list;
 using std::make_pair;
@@ -52,6 +53,7 @@ static void AddSymbolReferences() {
   REF_MODULE(BlockNameIO);
   REF_MODULE(StreamNameIO);
   REF_MODULE(NullNameIO);
+  REF_MODULE(SivNameIO);
 }
 
 struct NameIOAlg {
@@ -146,42 +148,74 @@ void NameIO::setReverseEncryption(bool enable) { reverseEncryption = enable; }
 
 bool NameIO::getReverseEncryption() const { return reverseEncryption; }
 
-string NameIO::recodePath(const string &path, int (NameIO::*_length)(int) const,
-                          string (NameIO::*_code)(const string &,
-                                                  uint64_t *) const,
-                          uint64_t *iv) const {
-  string output;
+bool NameIO::recodePath(const char *path, size_t length,
+                        int (NameIO::*_length)(int) const, NameCoder _code,
+                        uint64_t *iv, string *result) const {
+  string &output = *result;
+  const size_t start = output.size();
+  const char *end = path + length;
 
-  for (auto it = path.begin(); it != path.end();) {
+  for (const char *it = path; it != end;) {
     bool isDotFile = (*it == '.');
-    auto next = std::find(it, path.end(), '/');
-    int len = std::distance(it, next);
+    const char *next = std::find(it, end, '/');
+    int len = next - it;
 
     if (*it == '/') {
       // don't start the string with '/'
-      output += output.empty() ? '+' : '/';
+      output += (output.size() == start) ? '+' : '/';
       len = 1;
-    } else if (*it == '+' && output.empty()) {
+    } else if (*it == '+' && output.size() == start) {
       output += '/';
       len = 1;
     } else if (isDotFile && (len <= 2) && (it[len - 1] == '.')) {
         output.append(len, '.');  // append [len] copies of '.'
     } else {
       int approxLen = (this->*_length)(len);
-      if (approxLen <= 0) throw Error("Filename too small to decode");
+      if (approxLen <= 0) return false;
 
-      // code the name
-      string input(it, it + len);
-      string coded = (this->*_code)(input, iv);
-
-      // append result to string
-      output.append(coded);
+      // code the name, appending the result to the output
+      if (!(this->*_code)(it, len, iv, &output)) return false;
     }
 
     it += len;
   }
 
-  return output;
+  return true;
+}
+
+bool NameIO::encodeNameTo(const char *name, int length, uint64_t *iv,
+                          string *output) const {
+  appendEncodedName(name, length, iv, output);
+  return true;
+}
+
+bool NameIO::decodeNameTo(const char *name, int length, uint64_t *iv,
+                          string *output) const {
+  return appendDecodedName(name, length, iv, output);
+}
+
+bool NameIO::appendDecodedName(const char *name, int length, uint64_t *iv,
+                               string *output) const {
+  string decoded;
+  if (!tryDecodeName(string(name, length), iv, &decoded)) return false;
+  output->append(decoded);
+  return true;
+}
+
+void NameIO::appendEncodedName(const char *name, int length, uint64_t *iv,
+                               string *output) const {
+  output->append(encodeName(string(name, length), iv));
+}
+
+bool NameIO::tryDecodeName(const string &name, uint64_t *iv,
+                           string *result) const {
+  try {
+    *result = decodeName(name, iv);
+    return true;
+  }
+  catch (Error &err) {
+    return false;
+  }
 }
 
 string NameIO::encodePath(const string &plaintextPath) const {
@@ -195,17 +229,33 @@ string NameIO::decodePath(const string &cipherPath) const {
 }
 
 string NameIO::_encodePath(const string &plaintextPath, uint64_t *iv) const {
+  string result;
+  _appendEncodedPath(plaintextPath.data(), plaintextPath.length(), iv,
+                     &result);
+  return result;
+}
+
+void NameIO::_appendEncodedPath(const char *path, size_t length, uint64_t *iv,
+                                string *output) const {
   // if chaining is not enabled, then the iv pointer is not used..
   if (!chainedNameIV) iv = nullptr;
-  return recodePath(plaintextPath, &NameIO::maxEncodedNameLen,
-                    &NameIO::encodeName, iv);
+  size_t start = output->size();
+  if (!recodePath(path, length, &NameIO::maxEncodedNameLen,
+                  &NameIO::encodeNameTo, iv, output)) {
+    output->resize(start);
+    throw Error("Filename too small to decode");
+  }
 }
 
 string NameIO::_decodePath(const string &cipherPath, uint64_t *iv) const {
   // if chaining is not enabled, then the iv pointer is not used..
   if (!chainedNameIV) iv = nullptr;
-  return recodePath(cipherPath, &NameIO::maxDecodedNameLen, &NameIO::decodeName,
-                    iv);
+  string result;
+  if (!recodePath(cipherPath.data(), cipherPath.length(),
+                  &NameIO::maxDecodedNameLen, &NameIO::decodeNameTo, iv,
+                  &result))
+    throw Error("Invalid encoded filename");
+  return result;
 }
 
 string NameIO::encodePath(const string &path, uint64_t *iv) const {
@@ -216,6 +266,36 @@ string NameIO::decodePath(const string &path, uint64_t *iv) const {
   return getReverseEncryption() ? _encodePath(path, iv) : _decodePath(path, iv);
 }
 
+bool NameIO::tryDecodePath(const string &path, uint64_t *iv,
+                           string *plaintextPath) const {
+  // in reverse mode, plaintext names are encoded, which doesn't fail.
+  if (getReverseEncryption()) {
+    *plaintextPath = _encodePath(path, iv);
+    return true;
+  }
+
+  if (!chainedNameIV) iv = nullptr;
+  plaintextPath->clear();
+  return recodePath(path.data(), path.length(), &NameIO::maxDecodedNameLen,
+                    &NameIO::decodeNameTo, iv, plaintextPath);
+}
+
+void NameIO::appendEncodedPath(const char *path, size_t length, uint64_t *iv,
+                               string *output) const {
+  if (!getReverseEncryption()) {
+    _appendEncodedPath(path, length, iv, output);
+    return;
+  }
+
+  if (!chainedNameIV) iv = nullptr;
+  size_t start = output->size();
+  if (!recodePath(path, length, &NameIO::maxDecodedNameLen,
+                  &NameIO::decodeNameTo, iv, output)) {
+    output->resize(start);
+    throw Error("Invalid encoded filename");
+  }
+}
+
 string NameIO::encodeName(const string &name) const {
   return getReverseEncryption() ? decodeName(name, nullptr)
                                 : encodeName(name, nullptr);
@@ -74,6 +74,17 @@ class NameIO {
   std::string encodePath(const std::string &plaintextPath, uint64_t *iv) const;
   std::string decodePath(const std::string &encodedPath, uint64_t *iv) const;
 
+  // Same as decodePath, but returns false instead of throwing if the path
+  // can't be decoded.  Directory listings use this, as a directory may hold
+  // many names which don't belong to encfs.
+  bool tryDecodePath(const std::string &encodedPath, uint64_t *iv,
+                     std::string *plaintextPath) const;
+
+  // Same as encodePath, but appends the result to output, so a caller which
+  // reuses its output string doesn't allocate once it has grown large enough.
+  void appendEncodedPath(const char *plaintextPath, size_t length,
+                         uint64_t *iv, std::string *output) const;
+
   virtual int maxEncodedNameLen(int plaintextNameLen) const = 0;
   virtual int maxDecodedNameLen(int encodedNameLen) const = 0;
 
@@ -87,14 +98,37 @@ class NameIO {
   virtual std::string decodeName(const std::string &name,
                                  uint64_t *iv) const = 0;
 
+  // Decode without throwing.  The default calls decodeName and catches the
+  // error, derived classes override it to avoid the exception.
+  virtual bool tryDecodeName(const std::string &name, uint64_t *iv,
+                             std::string *result) const;
+
+  // Encode length bytes of name and append the result to output.  The
+  // default calls encodeName, derived classes override it to encode directly
+  // into output.
+  virtual void appendEncodedName(const char *name, int length, uint64_t *iv,
+                                 std::string *output) const;
+
+  // Decode length bytes of name and append the result to output, leaving
+  // output as it was on failure.  The default calls tryDecodeName.
+  virtual bool appendDecodedName(const char *name, int length, uint64_t *iv,
+                                 std::string *output) const;
+
  private:
-  std::string recodePath(const std::string &path,
-                         int (NameIO::*codingLen)(int) const,
-                         std::string (NameIO::*codingFunc)(const std::string &,
-                                                           uint64_t *) const,
-                         uint64_t *iv) const;
+  typedef bool (NameIO::*NameCoder)(const char *, int, uint64_t *,
+                                    std::string *) const;
+
+  bool recodePath(const char *path, size_t length,
+                  int (NameIO::*codingLen)(int) const, NameCoder codingFunc,
+                  uint64_t *iv, std::string *output) const;
+  bool encodeNameTo(const char *name, int length, uint64_t *iv,
+                    std::string *output) const;
+  bool decodeNameTo(const char *name, int length, uint64_t *iv,
+                    std::string *output) const;
 
   std::string _encodePath(const std::string &plaintextPath, uint64_t *iv) const;
+  void _appendEncodedPath(const char *plaintextPath, size_t length,
+                          uint64_t *iv, std::string *output) const;
   std::string _decodePath(const std::string &encodedPath, uint64_t *iv) const;
 
   bool chainedNameIV;
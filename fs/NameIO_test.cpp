@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <string>
 
+#include "base/Error.h"
 #include "cipher/CipherV1.h"
 
 #include "fs/BlockNameIO.h"
@@ -52,6 +53,52 @@ TEST(NameIOTest, NameIO) {
         string decoded = io->decodeName(encoded);
         ASSERT_EQ(name, decoded);
       }
+
+      // Foreign names are reported without throwing, unless the algorithm
+      // accepts any name.
+      for (string path : TEST_PATHS) {
+        uint64_t iv = 0;
+        string decoded;
+        ASSERT_TRUE(io->tryDecodePath(io->encodePath(path), &iv, &decoded));
+        ASSERT_EQ(path, decoded);
+      }
+      string decoded;
+      uint64_t iv = 0;
+      bool valid = io->tryDecodePath("not-an-encfs-name.tmp", &iv, &decoded);
+      if (algorithm.name != "Null") {
+        ASSERT_FALSE(valid);
+      }
+
+      // Appending to a prefix matches encodePath.
+      for (string path : TEST_PATHS) {
+        uint64_t iv = 0;
+        string encoded("/root/");
+        io->appendEncodedPath(path.data(), path.length(), &iv, &encoded);
+        ASSERT_EQ("/root/" + io->encodePath(path), encoded);
+      }
+
+      // In reverse mode, appending decodes in place, and a failed decode
+      // leaves the prefix as it was.
+      for (string path : TEST_PATHS) {
+        string cipherPath = io->encodePath(path);
+        io->setReverseEncryption(true);
+        uint64_t iv = 0;
+        string decoded("/root/");
+        io->appendEncodedPath(cipherPath.data(), cipherPath.length(), &iv,
+                              &decoded);
+        ASSERT_EQ("/root/" + path, decoded);
+        io->setReverseEncryption(false);
+      }
+      if (algorithm.name != "Null") {
+        io->setReverseEncryption(true);
+        uint64_t iv = 0;
+        string decoded("/root/");
+        EXPECT_THROW(io->appendEncodedPath("not-an-encfs-name.tmp", 21, &iv,
+                                           &decoded),
+                     Error);
+        EXPECT_EQ("/root/", decoded);
+        io->setReverseEncryption(false);
+      }
     }
   }
 }
@@ -58,10 +58,27 @@ string NullNameIO::encodeName(const string &plaintextName, uint64_t *iv) const {
   return plaintextName;
 }
 
+void NullNameIO::appendEncodedName(const char *plaintextName, int length,
+                                   uint64_t *iv, string *output) const {
+  output->append(plaintextName, length);
+}
+
 string NullNameIO::decodeName(const string &encodedName, uint64_t *iv) const {
   return encodedName;
 }
 
+bool NullNameIO::tryDecodeName(const string &encodedName, uint64_t *iv,
+                               string *result) const {
+  *result = encodedName;
+  return true;
+}
+
+bool NullNameIO::appendDecodedName(const char *encodedName, int length,
+                                   uint64_t *iv, string *output) const {
+  output->append(encodedName, length);
+  return true;
+}
+
 bool NullNameIO::Enabled() { return true; }
 
 }  // namespace encfs
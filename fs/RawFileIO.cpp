@@ -23,6 +23,7 @@
 #endif
 #include <unistd.h>
 
+#include "base/config.h"
 #include "base/Error.h"
 #include "fs/RawFileIO.h"
 
@@ -34,11 +35,22 @@
 #include <cstring>
 
 #include <cerrno>
+#include <limits>
+#include <utility>
+#include <vector>
 
 namespace encfs {
 
 static Interface RawFileIO_iface = makeInterface("FileIO/Raw", 1, 0, 0);
 
+// Number of consecutive sequential (or random) reads before the access
+// pattern is passed on to the backing file.
+static const int AccessPatternThreshold = 4;
+
+// Read ciphertext is dropped from the page cache in runs of at least this
+// many bytes, so that sequential reads don't pay a system call per block.
+static const off_t DropChunkBytes = 1024 * 1024;
+
 inline void swap(int &x, int &y) {
   int tmp = x;
   x = y;
@@ -46,7 +58,18 @@ inline void swap(int &x, int &y) {
 }
 
 RawFileIO::RawFileIO()
-    : knownSize(false), fileSize(0), fd(-1), oldfd(-1), canWrite(false) {}
+    : knownSize(false),
+      fileSize(0),
+      fd(-1),
+      oldfd(-1),
+      canWrite(false),
+      dropCache(false),
+      lastReadEnd(-1),
+      dropStart(0),
+      lastSequential(false),
+      patternCount(0),
+      advice(0),
+      trackChanges(false) {}
 
 RawFileIO::RawFileIO(const std::string &fileName)
     : name(fileName),
@@ -54,9 +77,19 @@ RawFileIO::RawFileIO(const std::string &fileName)
       fileSize(0),
       fd(-1),
       oldfd(-1),
-      canWrite(false) {}
+      canWrite(false),
+      dropCache(false),
+      lastReadEnd(-1),
+      dropStart(0),
+      lastSequential(false),
+      patternCount(0),
+      advice(0),
+      trackChanges(false) {}
 
 RawFileIO::~RawFileIO() {
+  saveChanges();
+  if (fd != -1) dropRead(lastReadEnd);
+
   int _fd = -1;
   int _oldfd = -1;
 
@@ -143,6 +176,7 @@ int RawFileIO::open(int flags) {
       canWrite = requestWrite;
       oldfd = fd;
       result = fd = newFd;
+      advice = 0;  // new descriptor, no hints yet
     } else {
       result = -errno;
       LOG(INFO) << "::open error: " << strerror(errno);
@@ -193,11 +227,73 @@ ssize_t RawFileIO::read(const IORequest &req) const {
   if (readSize < 0) {
     LOG(INFO) << "read failed at offset " << req.offset << " for "
               << req.dataLen << " bytes: " << strerror(errno);
+  } else {
+    adviseRead(req);
   }
 
   return readSize;
 }
 
+void RawFileIO::setDropCache(bool enable) { dropCache = enable; }
+
+void RawFileIO::setTrackChanges(bool enable) { trackChanges = enable; }
+
+void RawFileIO::adviseRead(const IORequest &req) const {
+#ifdef HAVE_POSIX_FADVISE
+  // Track whether reads follow on from each other, and let the backing file
+  // know once a pattern is established, so that it can adjust readahead.
+  bool sequential = (req.offset == lastReadEnd);
+  off_t previousEnd = lastReadEnd;
+  if (sequential == lastSequential) {
+    ++patternCount;
+  } else {
+    lastSequential = sequential;
+    patternCount = 1;
+  }
+  lastReadEnd = req.offset + req.dataLen;
+
+  int wanted = sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM;
+  if (patternCount >= AccessPatternThreshold && advice != wanted) {
+    VLOG(1) << "advising " << (sequential ? "sequential" : "random")
+            << " access for " << name;
+    advice = wanted;
+    ::posix_fadvise(fd, 0, 0, advice);
+  }
+
+  // the ciphertext is of no further use once it has been decoded.  The
+  // kernel only drops whole pages, so consumed data is dropped in large
+  // page aligned runs, and whatever is left of a run when reads jump
+  // elsewhere.
+  if (dropCache) {
+    if (!sequential) {
+      dropRead(previousEnd);
+      dropStart = req.offset;
+    }
+    if (lastReadEnd - dropStart >= DropChunkBytes) dropRead(lastReadEnd);
+  }
+#else
+  (void)req;
+#endif
+}
+
+// Drop the pages of the backing file read from dropStart up to end.
+void RawFileIO::dropRead(off_t end) const {
+#ifdef HAVE_POSIX_FADVISE
+  static const off_t pageSize = sysconf(_SC_PAGESIZE);
+
+  if (!dropCache || end <= dropStart) return;
+
+  off_t start = ((dropStart + pageSize - 1) / pageSize) * pageSize;
+  off_t stop = (end / pageSize) * pageSize;
+  if (stop > start) {
+    ::posix_fadvise(fd, start, stop - start, POSIX_FADV_DONTNEED);
+    dropStart = stop;
+  }
+#else
+  (void)end;
+#endif
+}
+
 bool RawFileIO::write(const IORequest &req) {
   rAssert(fd >= 0);
   rAssert(true == canWrite);
@@ -209,6 +305,7 @@ bool RawFileIO::write(const IORequest &req) {
   ssize_t bytes = req.dataLen;
   off_t offset = req.offset;
 
+  markAhead(req.offset, req.dataLen);
   while (bytes && retrys > 0) {
     ssize_t writeSize = ::pwrite(fd, buf, bytes, offset);
 
@@ -235,6 +332,7 @@ bool RawFileIO::write(const IORequest &req) {
       off_t last = req.offset + req.dataLen;
       if (last > fileSize) fileSize = last;
     }
+    if (trackChanges) changes.mark(req.offset, req.dataLen);
 
     return true;
   }
@@ -242,6 +340,8 @@ bool RawFileIO::write(const IORequest &req) {
 
 int RawFileIO::truncate(off_t size) {
   int res;
+  off_t oldSize = trackChanges ? getSize() : 0;
+  markAhead(oldSize, size - oldSize);
 
   if (fd >= 0 && canWrite) {
     res = ::ftruncate(fd, size);
@@ -261,11 +361,120 @@ int RawFileIO::truncate(off_t size) {
     res = 0;
     fileSize = size;
     knownSize = true;
+    if (trackChanges) changes.mark(oldSize, size - oldSize);
   }
 
   return res;
 }
 
+int RawFileIO::allocate(off_t offset, off_t length) {
+  int res = open(O_RDWR);
+  if (res < 0) return res;
+
+  off_t oldSize = trackChanges ? getSize() : 0;
+  markAhead(oldSize, offset + length - oldSize);
+
+  // posix_fallocate returns the error code rather than setting errno.
+  int eno = ::posix_fallocate(fd, offset, length);
+  if (eno == EINVAL || eno == EOPNOTSUPP) {
+    VLOG(1) << "posix_fallocate not supported for " << name
+            << ", falling back to truncate";
+    return FileIO::allocate(offset, length);
+  }
+
+  knownSize = false;
+  if (eno != 0) {
+    LOG(INFO) << "allocate failed for " << name << " (" << fd << ") range "
+              << offset << "+" << length << ", error " << strerror(eno);
+    return -eno;
+  }
+
+  if (trackChanges) changes.mark(oldSize, offset + length - oldSize);
+  return 0;
+}
+
+int RawFileIO::punchHole(off_t offset, off_t length) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+  int res = open(O_RDWR);
+  if (res < 0) return res;
+
+  markAhead(offset, length);
+  if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                  length) < 0) {
+    int eno = errno;
+    VLOG(1) << "punch hole failed for " << name << " range " << offset << "+"
+            << length << ": " << strerror(eno);
+    return -eno;
+  }
+
+  if (trackChanges) changes.mark(offset, length);
+  return 0;
+#else
+  return FileIO::punchHole(offset, length);
+#endif
+}
+
+int RawFileIO::flush() {
+  saveChanges();
+  return 0;
+}
+
+// Mark the units of a range in the stored record before the range is
+// changed, so that a crash can't lose the change.  Only units which aren't
+// marked yet cause the record to be written, so that happens at most once
+// per unit until the record is reset.
+void RawFileIO::markAhead(off_t offset, off_t length) {
+  if (!trackChanges || saved.covers(offset, length)) return;
+
+  ChangeRecord record;
+  int res = readChangeRecord(fd, name.c_str(), &record);
+  if (res == 0 || res == -ENODATA) {
+    record.mark(offset, length);
+    res = writeChangeRecord(fd, name.c_str(), record);
+  }
+
+  if (res < 0) {
+    LOG(WARNING) << "unable to save change record of " << name << ": "
+                 << strerror(-res);
+    // don't try again for every write, flush() does that.
+    saved.mark(offset, length);
+    return;
+  }
+  saved = record;
+}
+
+// Add the pending changes to the record stored with the file.  The stored
+// record is read again each time, so that a reset by a backup tool while the
+// file is open only keeps the changes made since then.  A reset is only
+// noticed here or when a new unit is written, so changes to units which were
+// already marked are only safe from a crash once this has run.
+void RawFileIO::saveChanges() {
+  if (!trackChanges || changes.empty()) return;
+
+  ChangeRecord record;
+  int res = readChangeRecord(fd, name.c_str(), &record);
+  if (res == 0 || res == -ENODATA) {
+    std::vector<std::pair<off_t, off_t> > ranges =
+        changes.ranges(std::numeric_limits<off_t>::max());
+    bool marked = true;
+    for (size_t i = 0; marked && i < ranges.size(); ++i)
+      marked = record.covers(ranges[i].first,
+                             ranges[i].second - ranges[i].first);
+    if (!marked) {
+      record.merge(changes);
+      res = writeChangeRecord(fd, name.c_str(), record);
+    }
+  }
+
+  if (res < 0) {
+    LOG(WARNING) << "unable to save change record of " << name << ": "
+                 << strerror(-res);
+    return;
+  }
+  saved = record;
+  changes.clear();
+}
+
 bool RawFileIO::isWritable() const { return canWrite; }
 
 }  // namespace encfs
@@ -21,6 +21,7 @@
 #ifndef _RawFileIO_incl_
 #define _RawFileIO_incl_
 
+#include "fs/ChangeRecord.h"
 #include "fs/FileIO.h"
 
 #include <string>
@@ -47,10 +48,27 @@ class RawFileIO : public FileIO {
   virtual bool write(const IORequest &req);
 
   virtual int truncate(off_t size);
+  virtual int allocate(off_t offset, off_t length);
+  virtual int punchHole(off_t offset, off_t length);
+  virtual int flush();
 
   virtual bool isWritable() const;
 
+  // If enabled, ciphertext is dropped from the page cache once it has been
+  // read, since the plaintext is cached by the kernel on the FUSE side.
+  void setDropCache(bool enable);
+
+  // If enabled, the units of the change record are marked in the stored record
+  // before they are first changed, and the changed ranges are added again on
+  // flush() and when the file is closed.
+  void setTrackChanges(bool enable);
+
  protected:
+  void adviseRead(const IORequest &req) const;
+  void dropRead(off_t end) const;
+  void markAhead(off_t offset, off_t length);
+  void saveChanges();
+
   std::string name;
 
   mutable bool knownSize;
@@ -59,6 +77,21 @@ class RawFileIO : public FileIO {
   int fd;
   int oldfd;
   bool canWrite;
+
+  // backing file cache policy, and access pattern tracking used to pass on
+  // sequential / random hints.
+  bool dropCache;
+  mutable off_t lastReadEnd;
+  mutable off_t dropStart;  // start of read data still in the page cache
+  mutable bool lastSequential;
+  mutable int patternCount;
+  mutable int advice;  // last posix_fadvise hint, 0 (normal) initially
+
+  // ranges changed since the change record was last saved, and the stored
+  // record as last read or written.
+  bool trackChanges;
+  ChangeRecord changes;
+  ChangeRecord saved;
 };
 
 }  // namespace encfs
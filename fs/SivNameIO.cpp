@@ -0,0 +1,142 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/base64.h"
+#include "base/Error.h"
+#include "base/i18n.h"
+#include "cipher/CipherV1.h"
+#include "fs/SivNameIO.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace encfs {
+
+using std::string;
+using std::vector;
+
+static const int TagSize = CipherV1::SIVTagSize;
+
+static shared_ptr<NameIO> NewSivNameIO(const Interface &iface,
+                                       const shared_ptr<CipherV1> &cipher) {
+  if (!cipher->hasSIV()) {
+    VLOG(1) << "SIV name encoding requires an AES cipher";
+    return shared_ptr<NameIO>();
+  }
+  return shared_ptr<NameIO>(new SivNameIO(iface, cipher));
+}
+
+static bool SivIO_registered = NameIO::Register(
+    "SIV",
+    // xgroup(setup)
+    gettext_noop("AES-SIV encoding, one cipher pass per name (AES only)"),
+    SivNameIO::CurrentInterface(), NewSivNameIO, false);
+
+/*
+    - Version 1.0 stores a 128 bit AES-SIV tag followed by the CTR encrypted
+      name, in base 64.
+*/
+Interface SivNameIO::CurrentInterface() {
+  return makeInterface("nameio/siv", 1, 0, 0);
+}
+
+SivNameIO::SivNameIO(const Interface &iface,
+                     const shared_ptr<CipherV1> &cipher)
+    : _cipher(cipher) {
+  (void)iface;
+}
+
+SivNameIO::~SivNameIO() {}
+
+Interface SivNameIO::interface() const { return CurrentInterface(); }
+
+int SivNameIO::maxEncodedNameLen(int plaintextNameLen) const {
+  return B256ToB64Bytes(plaintextNameLen + TagSize);
+}
+
+int SivNameIO::maxDecodedNameLen(int encodedNameLen) const {
+  return B64ToB256Bytes(encodedNameLen) - TagSize;
+}
+
+string SivNameIO::encodeName(const string &plaintextName, uint64_t *iv) const {
+  string result;
+  appendEncodedName(plaintextName.data(), plaintextName.length(), iv, &result);
+  return result;
+}
+
+void SivNameIO::appendEncodedName(const char *plaintextName, int length,
+                                  uint64_t *iv, string *output) const {
+  int encodedStreamLen = length + TagSize;
+  int encLen64 = B256ToB64Bytes(encodedStreamLen);
+
+  // encode in place, at the end of the output.
+  size_t start = output->size();
+  output->resize(start + encLen64);
+  byte *encoded = reinterpret_cast<byte *>(&(*output)[start]);
+
+  memcpy(encoded + TagSize, plaintextName, length);
+  if (!_cipher->sivEncode(encoded, encoded + TagSize, length, iv)) {
+    output->resize(start);
+    throw Error("SIV encoding failed");
+  }
+
+  changeBase2Inline(encoded, encodedStreamLen, 8, 6, true);
+  B64ToAscii(encoded, encLen64);
+}
+
+string SivNameIO::decodeName(const string &encodedName, uint64_t *iv) const {
+  string result;
+  if (!tryDecodeName(encodedName, iv, &result))
+    throw Error("Invalid encoded filename");
+  return result;
+}
+
+bool SivNameIO::tryDecodeName(const string &encodedName, uint64_t *iv,
+                              string *result) const {
+  int length = encodedName.length();
+  int decodedStreamLen = maxDecodedNameLen(length);
+
+  if (decodedStreamLen <= 0) {
+    VLOG(1) << "filename too small to decode";
+    return false;
+  }
+
+  vector<byte> tmpBuf(length, 0);
+  memcpy(tmpBuf.data(), encodedName.data(), length);
+  AsciiToB64(tmpBuf.data(), length);
+  changeBase2Inline(tmpBuf.data(), length, 6, 8, false);
+
+  if (!_cipher->sivDecode(tmpBuf.data(), &tmpBuf.at(TagSize), decodedStreamLen,
+                          iv)) {
+    VLOG(1) << "tag mismatch on decode of " << decodedStreamLen << " bytes";
+    return false;
+  }
+
+  result->assign(reinterpret_cast<char *>(&tmpBuf.at(TagSize)),
+                 decodedStreamLen);
+  return true;
+}
+
+bool SivNameIO::Enabled() { return true; }
+
+}  // namespace encfs
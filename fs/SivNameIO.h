@@ -0,0 +1,71 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SivNameIO_incl_
+#define _SivNameIO_incl_
+
+#include "fs/NameIO.h"
+
+namespace encfs {
+
+class CipherV1;
+
+/*
+    Deterministic authenticated name encoding using AES-SIV.  Each name is
+    encoded in one pass: a 128 bit CMAC tag over the name (and the chained
+    IV, if any), followed by the name encrypted in CTR mode using the tag as
+    the counter.  Unlike Block and Stream encoding, this doesn't use the
+    HMAC, so names are encoded without taking the HMAC lock.
+
+    Requires an AES cipher.
+*/
+class SivNameIO : public NameIO {
+ public:
+  static Interface CurrentInterface();
+
+  SivNameIO(const Interface &iface, const shared_ptr<CipherV1> &cipher);
+  virtual ~SivNameIO();
+
+  virtual Interface interface() const override;
+
+  virtual int maxEncodedNameLen(int plaintextNameLen) const override;
+  virtual int maxDecodedNameLen(int encodedNameLen) const override;
+
+  // hack to help with static builds
+  static bool Enabled();
+
+ protected:
+  virtual std::string encodeName(const std::string &plaintextName,
+                                 uint64_t *iv) const override;
+  virtual std::string decodeName(const std::string &encodedName,
+                                 uint64_t *iv) const override;
+  virtual void appendEncodedName(const char *plaintextName, int length,
+                                 uint64_t *iv,
+                                 std::string *output) const override;
+  virtual bool tryDecodeName(const std::string &encodedName, uint64_t *iv,
+                             std::string *result) const override;
+
+ private:
+  shared_ptr<CipherV1> _cipher;
+};
+
+}  // namespace encfs
+
+#endif
@@ -28,12 +28,10 @@
 
 #include <cstring>
 #include <string>
-#include <vector>
 
 namespace encfs {
 
 using std::string;
-using std::vector;
 
 static shared_ptr<NameIO> NewStreamNameIO(const Interface &iface,
                                           const shared_ptr<CipherV1> &cipher) {
@@ -93,49 +91,73 @@ int StreamNameIO::maxDecodedNameLen(int encodedStreamLen) const {
 
 string StreamNameIO::encodeName(const string &plaintextName,
                                 uint64_t *iv) const {
+  string result;
+  appendEncodedName(plaintextName.data(), plaintextName.length(), iv, &result);
+  return result;
+}
+
+void StreamNameIO::appendEncodedName(const char *plaintextName, int length,
+                                     uint64_t *iv, string *output) const {
   uint64_t tmpIV = 0;
-  int length = plaintextName.length();
   if (iv && _interface >= 2) tmpIV = *iv;
 
   unsigned int mac = _cipher->reduceMac16(_cipher->MAC_64(
-      reinterpret_cast<const byte *>(plaintextName.data()), length, iv));
+      reinterpret_cast<const byte *>(plaintextName), length, iv));
   tmpIV ^= (uint64_t)mac;
 
   int encodedStreamLen = length + 2;
   int encLen64 = B256ToB64Bytes(encodedStreamLen);
 
+  // encode in place, at the end of the output.
+  size_t start = output->size();
+  output->resize(start + encLen64);
+  byte *encoded = reinterpret_cast<byte *>(&(*output)[start]);
+
   // add on checksum bytes
-  vector<byte> encoded(encLen64);
   encoded[0] = static_cast<byte>((mac >> 8) & 0xff);
   encoded[1] = static_cast<byte>((mac) & 0xff);
 
   // stream encode the plaintext bytes
-  memcpy(&encoded[2], plaintextName.data(), length);
-  _cipher->streamEncode(&encoded[2], length, tmpIV);
+  memcpy(encoded + 2, plaintextName, length);
+  _cipher->streamEncode(encoded + 2, length, tmpIV);
 
   // convert the entire thing to base 64 ascii..
-  changeBase2Inline(encoded.data(), encodedStreamLen, 8, 6, true);
-  B64ToAscii(encoded.data(), encLen64);
-
-  return string(encoded.begin(), encoded.end());
+  changeBase2Inline(encoded, encodedStreamLen, 8, 6, true);
+  B64ToAscii(encoded, encLen64);
 }
 
 string StreamNameIO::decodeName(const string &encodedName,
                                 uint64_t *iv) const {
-  int length = encodedName.length();
-  rAssert(length > 2);
+  string result;
+  if (!tryDecodeName(encodedName, iv, &result))
+    throw Error("Invalid encoded filename");
+  return result;
+}
+
+bool StreamNameIO::tryDecodeName(const string &encodedName, uint64_t *iv,
+                                 string *result) const {
+  result->clear();
+  return appendDecodedName(encodedName.data(), encodedName.length(), iv,
+                           result);
+}
+
+bool StreamNameIO::appendDecodedName(const char *encodedName, int length,
+                                     uint64_t *iv, string *output) const {
   int decLen256 = B64ToB256Bytes(length);
   int decodedStreamLen = decLen256 - 2;
 
-  if (decodedStreamLen <= 0) throw Error("Filename too small to decode");
-
-  vector<byte> tmpBuf(length, 0);
+  if (length <= 2 || decodedStreamLen <= 0) {
+    VLOG(1) << "filename too small to decode";
+    return false;
+  }
 
-  // decode into tmpBuf, because this step produces more data then we can fit
-  // into the result buffer..
-  memcpy(tmpBuf.data(), encodedName.data(), length);
-  AsciiToB64(tmpBuf.data(), length);
-  changeBase2Inline(tmpBuf.data(), length, 6, 8, false);
+  // decode in place at the end of the output, which has room for the
+  // encoded name, then move the name down over the checksum.
+  size_t start = output->size();
+  output->append(encodedName, length);
+  byte *tmpBuf = reinterpret_cast<byte *>(&(*output)[start]);
+  AsciiToB64(tmpBuf, length);
+  changeBase2Inline(tmpBuf, length, 6, 8, false);
 
   // pull out the checksum value which is used as an initialization vector
   uint64_t tmpIV = 0;
@@ -145,19 +167,22 @@ string StreamNameIO::decodeName(const string &encodedName,
   if (iv && _interface >= 2) tmpIV = *iv;
 
   tmpIV ^= (uint64_t)mac;
-  _cipher->streamDecode(&tmpBuf.at(2), decodedStreamLen, tmpIV);
+  _cipher->streamDecode(tmpBuf + 2, decodedStreamLen, tmpIV);
 
   // compute MAC to check with stored value
-  unsigned int mac2 = _cipher->reduceMac16(
-      _cipher->MAC_64(&tmpBuf.at(2), decodedStreamLen, iv));
+  unsigned int mac2 =
+      _cipher->reduceMac16(_cipher->MAC_64(tmpBuf + 2, decodedStreamLen, iv));
 
   if (mac2 != mac) {
     VLOG(1) << "checksum mismatch: expected " << mac << ", got " << mac2
             << "on decode of " << decodedStreamLen << " bytes";
-    throw Error("checksum mismatch in filename decode");
+    output->resize(start);
+    return false;
   }
 
-  return string(reinterpret_cast<char*>(&tmpBuf.at(2)), decodedStreamLen);
+  memmove(tmpBuf, tmpBuf + 2, decodedStreamLen);
+  output->resize(start + decodedStreamLen);
+  return true;
 }
 
 bool StreamNameIO::Enabled() { return true; }
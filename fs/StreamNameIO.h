@@ -47,6 +47,14 @@ class StreamNameIO : public NameIO {
                                  uint64_t *iv) const override;
   virtual std::string decodeName(const std::string &encodedName,
                                  uint64_t *iv) const override;
+  virtual void appendEncodedName(const char *plaintextName, int length,
+                                 uint64_t *iv,
+                                 std::string *output) const override;
+  virtual bool tryDecodeName(const std::string &encodedName, uint64_t *iv,
+                             std::string *result) const override;
+  virtual bool appendDecodedName(const char *encodedName, int length,
+                                 uint64_t *iv,
+                                 std::string *output) const override;
 
  private:
   int _interface;
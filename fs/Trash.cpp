@@ -0,0 +1,231 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fs/Trash.h"
+
+#include <glog/logging.h>
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace encfs {
+
+const char TrashDirName[] = ".encfs_trash";
+
+// Space freed from a file in the trash by each step of the reaper, and the
+// pause between steps.
+static const off_t ReapStepBytes = 64 * 1024 * 1024;
+static const int ReapIntervalMs = 100;
+
+Trash::Trash(const std::string &rootDir)
+    : dir(rootDir), counter(0), running(false), pending(true) {
+  if (dir.empty() || dir[dir.length() - 1] != '/') dir.append(1, '/');
+  dir.append(TrashDirName);
+
+#ifdef CMAKE_USE_PTHREADS_INIT
+  started = false;
+  pthread_cond_init(&wakeup, 0);
+#endif
+}
+
+Trash::~Trash() {
+  stop();
+
+#ifdef CMAKE_USE_PTHREADS_INIT
+  pthread_cond_destroy(&wakeup);
+#endif
+}
+
+int Trash::add(const std::string &cipherPath) {
+  struct stat st;
+  if (::lstat(cipherPath.c_str(), &st) != 0) return -errno;
+  // the reaper only frees files, directories are removed by rmdir.
+  if (S_ISDIR(st.st_mode)) return -EISDIR;
+
+  char name[64];
+  {
+    Lock lock(mutex);
+    if (!running) return -ENOTSUP;
+
+    // names have to stay unique across mounts, since the trash may still
+    // hold files from before a crash.
+    snprintf(name, sizeof(name), "/%lx.%lx.%" PRIx64, (unsigned long)time(0),
+             (unsigned long)getpid(), ++counter);
+  }
+
+  std::string trashPath = dir + name;
+  int res = ::rename(cipherPath.c_str(), trashPath.c_str());
+  if (res != 0 && errno == ENOENT) {
+    if (::mkdir(dir.c_str(), 0700) == 0 || errno == EEXIST)
+      res = ::rename(cipherPath.c_str(), trashPath.c_str());
+  }
+
+  if (res != 0) {
+    res = -errno;
+    VLOG(1) << "unable to move " << cipherPath
+            << " to trash: " << strerror(-res);
+    return res;
+  }
+
+  VLOG(1) << "moved " << cipherPath << " to trash as " << trashPath;
+
+  Lock lock(mutex);
+  if (!pending) {
+    pending = true;
+#ifdef CMAKE_USE_PTHREADS_INIT
+    pthread_cond_signal(&wakeup);
+#endif
+  }
+  return 0;
+}
+
+bool Trash::start() {
+#ifdef CMAKE_USE_PTHREADS_INIT
+  Lock lock(mutex);
+  if (started) return true;
+
+  VLOG(1) << "starting trash reaper thread";
+  running = true;
+  pending = true;
+
+  int res = pthread_create(&thread, 0, reaper, (void *)this);
+  if (res != 0) {
+    LOG(ERROR) << "error starting trash reaper thread, res = " << res;
+    running = false;
+    return false;
+  }
+
+  started = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Trash::stop() {
+#ifdef CMAKE_USE_PTHREADS_INIT
+  {
+    Lock lock(mutex);
+    if (!started) return;
+
+    running = false;
+    pthread_cond_signal(&wakeup);
+  }
+
+  VLOG(1) << "joining with trash reaper thread";
+  pthread_join(thread, 0);
+  started = false;
+#endif
+}
+
+void Trash::purge(const std::string &rootDir) {
+  std::string trashDir = rootDir;
+  if (trashDir.empty() || trashDir[trashDir.length() - 1] != '/')
+    trashDir.append(1, '/');
+  trashDir.append(TrashDirName);
+
+  int count = 0;
+  while (reapStep(trashDir, 0)) ++count;
+
+  if (count > 0) LOG(INFO) << "freed " << count << " files left in trash";
+  ::rmdir(trashDir.c_str());
+}
+
+void *Trash::reaper(void *arg) {
+#ifdef CMAKE_USE_PTHREADS_INIT
+  Trash *trash = static_cast<Trash *>(arg);
+
+  trash->mutex.lock();
+  while (trash->running) {
+    if (!trash->pending) {
+      pthread_cond_wait(&trash->wakeup, &trash->mutex._mutex);
+      continue;
+    }
+
+    // cleared before looking, so that files added meanwhile aren't missed.
+    trash->pending = false;
+    trash->mutex.unlock();
+
+    bool more = reapStep(trash->dir, ReapStepBytes);
+
+    trash->mutex.lock();
+    if (!more) continue;
+    trash->pending = true;
+
+    struct timeval currentTime;
+    gettimeofday(&currentTime, 0);
+    long usec = currentTime.tv_usec + ReapIntervalMs * 1000L;
+    struct timespec wakeupTime;
+    wakeupTime.tv_sec = currentTime.tv_sec + usec / 1000000;
+    wakeupTime.tv_nsec = (usec % 1000000) * 1000;
+    pthread_cond_timedwait(&trash->wakeup, &trash->mutex._mutex, &wakeupTime);
+  }
+  trash->mutex.unlock();
+
+  VLOG(1) << "trash reaper thread exiting";
+#else
+  (void)arg;
+#endif
+  return 0;
+}
+
+bool Trash::reapStep(const std::string &dir, off_t stepBytes) {
+  DIR *d = ::opendir(dir.c_str());
+  if (!d) return false;
+
+  std::string path;
+  struct dirent *de;
+  while ((de = ::readdir(d)) != NULL) {
+    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+      continue;
+    path = dir + '/' + de->d_name;
+    break;
+  }
+  ::closedir(d);
+
+  if (path.empty()) return false;
+
+  // Shrink large files from the end, so their blocks are released a bit at
+  // a time.  A file with other links still holds data somebody can see, so
+  // it is only unlinked.
+  struct stat st;
+  if (stepBytes > 0 && ::lstat(path.c_str(), &st) == 0 &&
+      S_ISREG(st.st_mode) && st.st_nlink == 1 && st.st_size > stepBytes) {
+    if (::truncate(path.c_str(), st.st_size - stepBytes) == 0) return true;
+  }
+
+  if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+    LOG(WARNING) << "unable to remove " << path
+                 << " from trash: " << strerror(errno);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace encfs
@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Trash_incl_
+#define _Trash_incl_
+
+#include "base/config.h"
+#include "base/Mutex.h"
+
+#include <stdint.h>
+
+#include <string>
+
+namespace encfs {
+
+// Name of the trash directory in the root of the cipher directory.  With
+// NullNameIO it is also a valid plaintext name, so DirNode hides it from
+// listings and lookups and refuses to create anything by that name.
+extern const char TrashDirName[];
+
+/*
+    Deferred deletion of backing files.
+
+    add() moves a backing file into the trash directory, which is a cheap
+    rename no matter how large the file is.  A reaper thread then frees the
+    space in the background, shrinking large files a step at a time so that
+    deleting a big file doesn't stall other I/O on the backing filesystem.
+
+    Anything left in the trash when encfs stops, or crashes, is freed on the
+    next mount.
+*/
+class Trash {
+ public:
+  explicit Trash(const std::string &rootDir);
+  ~Trash();
+
+  // Move a backing file into the trash.  Returns 0 on success, -errno if the
+  // file has to be unlinked directly instead.
+  int add(const std::string &cipherPath);
+
+  // Start or stop the reaper thread.  The reaper first frees anything left
+  // over from an earlier mount.
+  bool start();
+  void stop();
+
+  // Free everything in the trash directory of rootDir right away.
+  static void purge(const std::string &rootDir);
+
+ private:
+  Trash(const Trash &src);             // not allowed
+  Trash &operator=(const Trash &src);  // not allowed
+
+  static void *reaper(void *arg);
+
+  // Free some space from one entry in the trash.  Returns false if the
+  // trash is empty.
+  static bool reapStep(const std::string &dir, off_t stepBytes);
+
+  std::string dir;
+  uint64_t counter;
+
+  Mutex mutex;
+  bool running;
+  bool pending;
+#ifdef CMAKE_USE_PTHREADS_INIT
+  bool started;
+  pthread_t thread;
+  pthread_cond_t wakeup;
+#endif
+};
+
+}  // namespace encfs
+
+#endif
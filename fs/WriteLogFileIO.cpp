@@ -0,0 +1,206 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fs/WriteLogFileIO.h"
+
+#include "base/Error.h"
+#include "cipher/MemoryPool.h"
+
+#include <glog/logging.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace encfs {
+
+static Interface WriteLogFileIO_iface =
+    makeInterface("FileIO/WriteLog", 1, 0, 0);
+
+// Amount of data held before the log is written out.
+static const int MaxLogBytes = 1024 * 1024;
+
+// Largest write passed on to the next layer when the log is written out.
+static const int MaxRunBytes = 128 * 1024;
+
+WriteLogFileIO::WriteLogFileIO(const shared_ptr<FileIO> &_base,
+                               const FSConfigPtr &cfg)
+    : BlockFileIO(_base->blockSize(), cfg), base(_base), logSize(0) {
+  maxBlocks = MaxLogBytes / blockSize();
+  if (maxBlocks < 1) maxBlocks = 1;
+
+  // blocks which were never written read as zeros here, and the next layer
+  // does its own padding when the log is written out.
+  _allowHoles = true;
+}
+
+WriteLogFileIO::~WriteLogFileIO() {
+  if (flush() < 0)
+    LOG(ERROR) << "lost " << log.size() << " logged blocks of "
+               << getFileName();
+  dropLog();
+}
+
+Interface WriteLogFileIO::interface() const { return WriteLogFileIO_iface; }
+
+int WriteLogFileIO::open(int flags) { return base->open(flags); }
+
+void WriteLogFileIO::setFileName(const char *fileName) {
+  base->setFileName(fileName);
+}
+
+const char *WriteLogFileIO::getFileName() const {
+  return base->getFileName();
+}
+
+bool WriteLogFileIO::setIV(uint64_t iv) {
+  if (flush() < 0) return false;
+  return base->setIV(iv);
+}
+
+int WriteLogFileIO::getAttr(struct stat *stbuf) const {
+  int res = base->getAttr(stbuf);
+
+  if (res == 0 && !log.empty() && S_ISREG(stbuf->st_mode))
+    stbuf->st_size = logSize;
+
+  return res;
+}
+
+off_t WriteLogFileIO::getSize() const {
+  if (log.empty()) return base->getSize();
+  return logSize;
+}
+
+void WriteLogFileIO::dropLog() {
+  for (BlockLog::iterator it = log.begin(); it != log.end(); ++it)
+    memset(&it->second[0], 0, it->second.size());
+  log.clear();
+}
+
+ssize_t WriteLogFileIO::readOneBlock(const IORequest &req) const {
+  off_t blockNum = req.offset / blockSize();
+
+  BlockLog::const_iterator it = log.find(blockNum);
+  if (it != log.end()) {
+    int len = it->second.size();
+    if (len > req.dataLen) len = req.dataLen;
+    memcpy(req.data, &it->second[0], len);
+    return len;
+  }
+
+  ssize_t readSize = base->read(req);
+  if (readSize < 0 || log.empty()) return readSize;
+
+  // blocks between the end of the next layer and logged blocks beyond it
+  // haven't been padded yet.
+  off_t fill = logSize - req.offset;
+  if (fill > req.dataLen) fill = req.dataLen;
+  if (readSize < fill) {
+    memset(req.data + readSize, 0, fill - readSize);
+    readSize = fill;
+  }
+  return readSize;
+}
+
+bool WriteLogFileIO::writeOneBlock(const IORequest &req) {
+  if (log.empty()) logSize = base->getSize();
+
+  std::vector<unsigned char> &block = log[req.offset / blockSize()];
+  if (!block.empty()) memset(&block[0], 0, block.size());
+  block.assign(req.data, req.data + req.dataLen);
+
+  if (req.offset + req.dataLen > logSize) logSize = req.offset + req.dataLen;
+
+  if ((int)log.size() >= maxBlocks) return flush() == 0;
+  return true;
+}
+
+int WriteLogFileIO::flush() {
+  if (log.empty()) return base->flush();
+
+  VLOG(1) << "writing " << log.size() << " logged blocks of " << getFileName();
+
+  int bs = blockSize();
+  int runBlocks = MaxRunBytes / bs;
+  if (runBlocks < 1) runBlocks = 1;
+
+  MemBlock mb;
+  mb.allocate(runBlocks * bs);
+
+  // write runs of consecutive blocks in order, so the next layer sees
+  // sequential writes.  Only the last block of the file can be partial.
+  BlockLog::iterator it = log.begin();
+  while (it != log.end()) {
+    IORequest req;
+    req.offset = it->first * bs;
+    req.data = mb.data;
+    req.dataLen = 0;
+
+    BlockLog::iterator end = it;
+    off_t next = it->first;
+    while (end != log.end() && end->first == next &&
+           req.dataLen < runBlocks * bs) {
+      int len = end->second.size();
+      memcpy(mb.data + req.dataLen, &end->second[0], len);
+      req.dataLen += len;
+      ++next;
+      ++end;
+      if (len < bs) break;
+    }
+
+    if (!base->write(req)) {
+      memset(mb.data, 0, runBlocks * bs);
+      return -EIO;
+    }
+
+    for (; it != end; ++it) memset(&it->second[0], 0, it->second.size());
+    log.erase(log.begin(), end);
+  }
+
+  memset(mb.data, 0, runBlocks * bs);
+  return base->flush();
+}
+
+int WriteLogFileIO::truncate(off_t size) {
+  int res = flush();
+  if (res < 0) return res;
+
+  invalidateCache();
+  return base->truncate(size);
+}
+
+int WriteLogFileIO::allocate(off_t offset, off_t length) {
+  int res = flush();
+  if (res < 0) return res;
+
+  return base->allocate(offset, length);
+}
+
+int WriteLogFileIO::punchHole(off_t offset, off_t length) {
+  int res = flush();
+  if (res < 0) return res;
+
+  invalidateCache();
+  return base->punchHole(offset, length);
+}
+
+bool WriteLogFileIO::isWritable() const { return base->isWritable(); }
+
+}  // namespace encfs
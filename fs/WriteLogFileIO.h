@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * Author:   EncFS contributors
+ *
+ *****************************************************************************
+ * Copyright (c) 2026, EncFS contributors
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WriteLogFileIO_incl_
+#define _WriteLogFileIO_incl_
+
+#include <map>
+#include <vector>
+
+#include "fs/BlockFileIO.h"
+
+namespace encfs {
+
+/*
+    Collects written blocks in memory, indexed by block number, and passes
+    them on to the next layer in block order when the log fills up, on
+    flush() and when destroyed.
+
+    Random writes into the same blocks are merged before they are encoded,
+    and a partial write to a logged block doesn't need to read and decode
+    the block again.  Data written here isn't in the backing file until the
+    log is flushed, so it must be the top layer of the FileNode, which
+    flushes it on close and fsync.
+*/
+class WriteLogFileIO : public BlockFileIO {
+ public:
+  WriteLogFileIO(const shared_ptr<FileIO> &base, const FSConfigPtr &cfg);
+  virtual ~WriteLogFileIO();
+
+  virtual Interface interface() const;
+
+  virtual void setFileName(const char *fileName);
+  virtual const char *getFileName() const;
+  virtual bool setIV(uint64_t iv);
+
+  virtual int open(int flags);
+  virtual int getAttr(struct stat *stbuf) const;
+  virtual off_t getSize() const;
+
+  virtual int truncate(off_t size);
+  virtual int allocate(off_t offset, off_t length);
+  virtual int punchHole(off_t offset, off_t length);
+  virtual int flush();
+
+  virtual bool isWritable() const;
+
+ private:
+  virtual ssize_t readOneBlock(const IORequest &req) const;
+  virtual bool writeOneBlock(const IORequest &req);
+
+  void dropLog();
+
+  typedef std::map<off_t, std::vector<unsigned char> > BlockLog;
+
+  shared_ptr<FileIO> base;
+  int maxBlocks;
+
+  // logged blocks, by block number, and the file size including them.
+  BlockLog log;
+  off_t logSize;
+};
+
+}  // namespace encfs
+
+#endif
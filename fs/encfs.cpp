@@ -58,6 +58,7 @@ using std::tuple;
 #include "base/Mutex.h"
 #include "base/Error.h"
 #include "cipher/MemoryPool.h"
+#include "fs/ChangeRecord.h"
 #include "fs/DirNode.h"
 #include "fs/FileUtils.h"
 #include "fs/Context.h"
@@ -102,11 +103,17 @@ static int withCipherPath(const char *opName, const char *path,
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
-    string cyName = FSRoot->cipherPath(path);
+    // open files already know their cipher name, which saves encoding it.
+    // The name buffer is kept per thread, so it only allocates while growing.
+    static thread_local string cyName;
+    if (!ctx->lookupCipherName(path, &cyName))
+      FSRoot->cipherPath(path, &cyName);
+    if (FSRoot->isTrash(cyName)) return -ENOENT;
     VLOG(1) << opName << " " << cyName.c_str();
 
     res = op(ctx, cyName, data);
@@ -131,16 +138,19 @@ static int withFileNode(const char *opName, const char *path,
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
-    shared_ptr<FileNode> fnode;
-
-    if (fi != NULL)
-      fnode = GET_FN(ctx, fi);
-    else
-      fnode = FSRoot->lookupNode(path, opName);
+    // open files are referenced by their placeholder until release, so only
+    // lookups by path need a reference of their own.
+    shared_ptr<FileNode> pathNode;
+    if (fi == NULL) {
+      pathNode = FSRoot->lookupNode(path, opName);
+      if (!pathNode) return -ENOENT;
+    }
+    const shared_ptr<FileNode> &fnode = fi ? GET_FN(ctx, fi) : pathNode;
 
     rAssert(fnode != NULL);
     VLOG(1) << opName << " " << fnode->cipherName();
@@ -154,26 +164,39 @@ static int withFileNode(const char *opName, const char *path,
   return res;
 }
 
+// Read and decode a symlink target, given the link's lstat info.  Decoded
+// targets are cached in the context, so getattr and readlink only decode a
+// link once until it changes.
+static int decodeLink(EncFS_Context *ctx, const shared_ptr<DirNode> &FSRoot,
+                      const string &cyName, const struct stat &stbuf,
+                      string *target) {
+  if (ctx->lookupLink(cyName, stbuf, target)) return ESUCCESS;
+
+  vector<char> buf(stbuf.st_size + 1, 0);
+  int res = ::readlink(cyName.c_str(), &buf[0], stbuf.st_size);
+  if (res < 0) return -errno;
+
+  // other functions expect c-strings to be null-terminated, which
+  // readlink doesn't provide
+  buf[res] = '\0';
+
+  *target = FSRoot->plainPath(&buf[0]);
+  if (!target->empty()) ctx->storeLink(cyName, stbuf, *target);
+
+  return ESUCCESS;
+}
+
 int _do_getattr(FileNode *fnode, struct stat *stbuf) {
   int res = fnode->getAttr(stbuf);
   if (res == ESUCCESS && S_ISLNK(stbuf->st_mode)) {
     EncFS_Context *ctx = context();
-    shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+    EncFS_Context::RootPin pin(ctx);
+    const shared_ptr<DirNode> &FSRoot = pin.root(&res);
     if (FSRoot) {
       // determine plaintext link size..  Easiest to read and decrypt..
-      vector<char> buf(stbuf->st_size + 1, 0);
-
-      res = ::readlink(fnode->cipherName(), &buf[0], stbuf->st_size);
-      if (res >= 0) {
-        // other functions expect c-strings to be null-terminated, which
-        // readlink doesn't provide
-        buf[res] = '\0';
-
-        stbuf->st_size = FSRoot->plainPath(&buf[0]).length();
-
-        res = ESUCCESS;
-      } else
-        res = -errno;
+      string target;
+      res = decodeLink(ctx, FSRoot, fnode->cipherName(), *stbuf, &target);
+      if (res == ESUCCESS) stbuf->st_size = target.length();
     }
   }
 
@@ -181,7 +204,15 @@ int _do_getattr(FileNode *fnode, struct stat *stbuf) {
 }
 
 int encfs_getattr(const char *path, struct stat *stbuf) {
-  return withFileNode("getattr", path, NULL, _do_getattr, stbuf);
+  // tools such as compilers and shells probe many paths which don't exist,
+  // so remember misses rather than encoding and checking them every time.
+  EncFS_Context *ctx = context();
+  uint64_t generation;
+  if (ctx->lookupMissing(path, &generation)) return -ENOENT;
+
+  int res = withFileNode("getattr", path, NULL, _do_getattr, stbuf);
+  if (res == -ENOENT) ctx->storeMissing(path, generation);
+  return res;
 }
 
 int encfs_fgetattr(const char *path, struct stat *stbuf,
@@ -193,7 +224,8 @@ int encfs_getdir(const char *path, fuse_dirh_t h, fuse_dirfil_t filler) {
   EncFS_Context *ctx = context();
 
   int res = ESUCCESS;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
@@ -230,11 +262,13 @@ int encfs_mknod(const char *path, mode_t mode, dev_t rdev) {
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
     shared_ptr<FileNode> fnode = FSRoot->lookupNode(path, "mknod");
+    if (!fnode) return -EPERM;
 
     VLOG(1) << "mknod on " << fnode->cipherName() << ", mode " << mode
             << ", dev " << rdev;
@@ -263,6 +297,8 @@ int encfs_mknod(const char *path, mode_t mode, dev_t rdev) {
   catch (Error &err) {
     LOG(ERROR) << "error caught in mknod: " << err.what();
   }
+  ctx->clearMissing(path);
+  ctx->clearXattrs(path);
   return res;
 }
 
@@ -271,7 +307,8 @@ int encfs_mkdir(const char *path, mode_t mode) {
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
@@ -296,6 +333,8 @@ int encfs_mkdir(const char *path, mode_t mode) {
   catch (Error &err) {
     LOG(ERROR) << "error caught in mkdir: " << err.what();
   }
+  ctx->clearMissing(path);
+  ctx->clearXattrs(path);
   return res;
 }
 
@@ -303,17 +342,22 @@ int encfs_unlink(const char *path) {
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
+    string cyName = FSRoot->cipherPath(path);
+
     // let DirNode handle it atomically so that it can handle race
     // conditions
     res = FSRoot->unlink(path);
+    ctx->clearLink(cyName.c_str());
   }
   catch (Error &err) {
     LOG(ERROR) << "error caught in unlink: " << err.what();
   }
+  ctx->clearXattrs(path);
   return res;
 }
 
@@ -323,7 +367,9 @@ int _do_rmdir(EncFS_Context *, const string &cipherPath, int) {
 }
 
 int encfs_rmdir(const char *path) {
-  return withCipherPath("rmdir", path, _do_rmdir, 0);
+  int res = withCipherPath("rmdir", path, _do_rmdir, 0);
+  context()->clearXattrs(path);
+  return res;
 }
 
 int _do_readlink(EncFS_Context *ctx, const string &cyName,
@@ -332,17 +378,18 @@ int _do_readlink(EncFS_Context *ctx, const string &cyName,
   size_t size = get<1>(data);
 
   int res = ESUCCESS;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
-  res = ::readlink(cyName.c_str(), buf, size - 1);
-
-  if (res == -1) return -errno;
+  struct stat stbuf;
+  if (::lstat(cyName.c_str(), &stbuf) == -1) return -errno;
+  if (!S_ISLNK(stbuf.st_mode)) return -EINVAL;
 
-  buf[res] = '\0';  // ensure null termination
   string decodedName;
   try {
-    decodedName = FSRoot->plainPath(buf);
+    res = decodeLink(ctx, FSRoot, cyName, stbuf, &decodedName);
+    if (res != ESUCCESS) return res;
   }
   catch (...) {
   }
@@ -366,13 +413,15 @@ int encfs_symlink(const char *from, const char *to) {
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
     // allow fully qualified names in symbolic links.
     string fromCName = FSRoot->relativeCipherPath(from);
     string toCName = FSRoot->cipherPath(to);
+    if (FSRoot->isTrash(toCName)) return -EPERM;
 
     VLOG(1) << "symlink " << fromCName << " -> " << toCName;
 
@@ -388,6 +437,7 @@ int encfs_symlink(const char *from, const char *to) {
     res = ::symlink(fromCName.c_str(), toCName.c_str());
     if (olduid >= 0) setfsuid(olduid);
     if (oldgid >= 0) setfsgid(oldgid);
+    ctx->clearLink(toCName.c_str());
 
     if (res == -1)
       res = -errno;
@@ -397,6 +447,8 @@ int encfs_symlink(const char *from, const char *to) {
   catch (Error &err) {
     LOG(ERROR) << "error caught in symlink: " << err.what();
   }
+  ctx->clearMissing(to);
+  ctx->clearXattrs(to);
   return res;
 }
 
@@ -404,7 +456,8 @@ int encfs_link(const char *from, const char *to) {
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
@@ -413,6 +466,8 @@ int encfs_link(const char *from, const char *to) {
   catch (Error &err) {
     LOG(ERROR) << "error caught in link: " << err.what();
   }
+  ctx->clearMissing(to);
+  ctx->clearXattrs(to);
   return res;
 }
 
@@ -420,7 +475,8 @@ int encfs_rename(const char *from, const char *to) {
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
@@ -429,6 +485,10 @@ int encfs_rename(const char *from, const char *to) {
   catch (Error &err) {
     LOG(ERROR) << "error caught in rename: " << err.what();
   }
+  // a renamed directory brings everything below it along.
+  ctx->clearLink(NULL);
+  ctx->clearMissing(NULL);
+  ctx->clearXattrs(NULL);
   return res;
 }
 
@@ -441,7 +501,10 @@ int _do_chmod(EncFS_Context *, const string &cipherPath, mode_t mode) {
 }
 
 int encfs_chmod(const char *path, mode_t mode) {
-  return withCipherPath("chmod", path, _do_chmod, mode);
+  // the mode is also stored in the access ACL.
+  int res = withCipherPath("chmod", path, _do_chmod, mode);
+  context()->clearXattrs(NULL);
+  return res;
 }
 
 int _do_chown(EncFS_Context *, const string &cyName, tuple<uid_t, gid_t> data) {
@@ -450,7 +513,10 @@ int _do_chown(EncFS_Context *, const string &cyName, tuple<uid_t, gid_t> data) {
 }
 
 int encfs_chown(const char *path, uid_t uid, gid_t gid) {
-  return withCipherPath("chown", path, _do_chown, make_tuple(uid, gid));
+  // changing the owner drops file capabilities.
+  int res = withCipherPath("chown", path, _do_chown, make_tuple(uid, gid));
+  context()->clearXattrs(NULL);
+  return res;
 }
 
 int _do_truncate(FileNode *fnode, off_t size) { return fnode->truncate(size); }
@@ -492,7 +558,8 @@ int encfs_open(const char *path, struct fuse_file_info *file) {
   EncFS_Context *ctx = context();
 
   int res = -EIO;
-  shared_ptr<DirNode> FSRoot = ctx->getRoot(&res);
+  EncFS_Context::RootPin pin(ctx);
+  const shared_ptr<DirNode> &FSRoot = pin.root(&res);
   if (!FSRoot) return res;
 
   try {
@@ -504,7 +571,15 @@ int encfs_open(const char *path, struct fuse_file_info *file) {
               << file->flags;
 
       if (res >= 0) {
-        file->fh = (uintptr_t)ctx->putNode(path, fnode);
+        // let the kernel keep cached data if the file hasn't changed since
+        // it was last released.
+        struct stat st;
+        bool haveStat = (fnode->getAttr(&st) == ESUCCESS);
+        if (haveStat)
+          file->keep_cache = ctx->keepCache(fnode->cipherName(), st);
+
+        file->fh =
+            (uintptr_t)ctx->putNode(path, fnode, haveStat ? &st : NULL);
         res = ESUCCESS;
       }
     }
@@ -521,7 +596,10 @@ int _do_flush(FileNode *fnode, int) {
      close the file.  However it is important to call close() for some
      underlying filesystems (like NFS).
    */
-  int res = fnode->open(O_RDONLY);
+  int res = fnode->flush();
+  if (res < 0) return res;
+
+  res = fnode->open(O_RDONLY);
   if (res >= 0) {
     int fh = res;
     res = close(dup(fh));
@@ -544,6 +622,13 @@ int encfs_release(const char *path, struct fuse_file_info *finfo) {
   EncFS_Context *ctx = context();
 
   try {
+    // remember what the file looked like after our own changes, so that a
+    // later open can tell if it was changed behind our back.
+    shared_ptr<FileNode> fnode = GET_FN(ctx, finfo);
+    struct stat st;
+    if (fnode && fnode->getAttr(&st) == ESUCCESS)
+      ctx->releasedFile(fnode->cipherName(), st);
+
     ctx->eraseNode(path, (void *)(uintptr_t)finfo->fh);
     return ESUCCESS;
   }
@@ -571,6 +656,22 @@ int encfs_fsync(const char *path, int dataSync, struct fuse_file_info *file) {
   return withFileNode("fsync", path, file, _do_fsync, dataSync);
 }
 
+#if FUSE_VERSION >= 29
+int _do_fallocate(FileNode *fnode, tuple<int, off_t, off_t> data) {
+  // Only plain allocation is supported.  Keeping the size or punching holes
+  // would leave partially encoded blocks behind.
+  if (get<0>(data) != 0) return -EOPNOTSUPP;
+
+  return fnode->allocate(get<1>(data), get<2>(data));
+}
+
+int encfs_fallocate(const char *path, int mode, off_t offset, off_t length,
+                    struct fuse_file_info *file) {
+  return withFileNode("fallocate", path, file, _do_fallocate,
+                      make_tuple(mode, offset, length));
+}
+#endif
+
 int _do_write(FileNode *fnode, tuple<const char *, size_t, off_t> data) {
   size_t size = get<1>(data);
   if (fnode->write(get<2>(data), (unsigned char *)get<0>(data), size))
@@ -611,6 +712,16 @@ int encfs_statfs(const char *path, struct statvfs *st) {
 
 #ifdef HAVE_XATTR
 
+// Attributes used by encfs itself on the encrypted files are hidden.
+static bool isPrivateAttribute(const char *name) {
+  return strcmp(name, ChangeRecordAttribute) == 0;
+}
+
+#ifdef ENOATTR
+static const int NoAttribute = ENOATTR;
+#else
+static const int NoAttribute = ENODATA;
+#endif
 
 #ifdef XATTR_ADD_OPT
 int _do_setxattr(EncFS_Context *, const string &cyName,
@@ -622,8 +733,11 @@ int _do_setxattr(EncFS_Context *, const string &cyName,
 int encfs_setxattr(const char *path, const char *name, const char *value,
                    size_t size, int flags, uint32_t position) {
   (void)flags;
-  return withCipherPath("setxattr", path, _do_setxattr,
-                        make_tuple(name, value, size, position));
+  if (isPrivateAttribute(name)) return -EPERM;
+  int res = withCipherPath("setxattr", path, _do_setxattr,
+                           make_tuple(name, value, size, position));
+  context()->clearXattrs(NULL);
+  return res;
 }
 #else
 int _do_setxattr(EncFS_Context *, const string &cyName,
@@ -633,12 +747,38 @@ int _do_setxattr(EncFS_Context *, const string &cyName,
 }
 int encfs_setxattr(const char *path, const char *name, const char *value,
                    size_t size, int flags) {
-  return withCipherPath("setxattr", path, _do_setxattr,
-                        make_tuple(name, value, size, flags));
+  if (isPrivateAttribute(name)) return -EPERM;
+  int res = withCipherPath("setxattr", path, _do_setxattr,
+                           make_tuple(name, value, size, flags));
+  context()->clearXattrs(NULL);
+  return res;
 }
 #endif
 
 
+// Return a cached attribute the way getxattr would.
+static int cachedXattr(bool present, const string &cached, char *value,
+                       size_t size) {
+  if (!present) return -NoAttribute;
+  if (size == 0) return cached.size();
+  if (size < cached.size()) return -ERANGE;
+
+  memcpy(value, cached.data(), cached.size());
+  return cached.size();
+}
+
+// The kernel asks for security.capability before writes, and ACL aware tools
+// ask for ACLs on every stat, so results are cached.  Writes can remove a
+// capability, so only its absence is kept.
+static void cacheXattr(EncFS_Context *ctx, const char *path, const char *name,
+                       uint64_t generation, int res, const char *value,
+                       size_t size) {
+  if (res == -NoAttribute)
+    ctx->storeXattr(path, name, generation, false, string());
+  else if (res >= 0 && size > 0 && strcmp(name, "security.capability") != 0)
+    ctx->storeXattr(path, name, generation, true, string(value, res));
+}
+
 #ifdef XATTR_ADD_OPT
 int _do_getxattr(EncFS_Context *, const string &cyName,
                  tuple<const char *, void *, size_t, uint32_t> data) {
@@ -648,8 +788,24 @@ int _do_getxattr(EncFS_Context *, const string &cyName,
 }
 int encfs_getxattr(const char *path, const char *name, char *value, size_t size,
                    uint32_t position) {
-  return withCipherPath("getxattr", path, _do_getxattr,
-                        make_tuple(name, (void *)value, size, position), true);
+  if (isPrivateAttribute(name)) return -NoAttribute;
+  if (position != 0)
+    return withCipherPath("getxattr", path, _do_getxattr,
+                          make_tuple(name, (void *)value, size, position),
+                          true);
+
+  EncFS_Context *ctx = context();
+  uint64_t generation;
+  bool present;
+  string cached;
+  if (ctx->lookupXattr(path, name, &generation, &present, &cached))
+    return cachedXattr(present, cached, value, size);
+
+  int res = withCipherPath("getxattr", path, _do_getxattr,
+                           make_tuple(name, (void *)value, size, position),
+                           true);
+  cacheXattr(ctx, path, name, generation, res, value, size);
+  return res;
 }
 #else
 int _do_getxattr(EncFS_Context *, const string &cyName,
@@ -658,8 +814,19 @@ int _do_getxattr(EncFS_Context *, const string &cyName,
 }
 int encfs_getxattr(const char *path, const char *name, char *value,
                    size_t size) {
-  return withCipherPath("getxattr", path, _do_getxattr,
-                        make_tuple(name, (void *)value, size), true);
+  if (isPrivateAttribute(name)) return -NoAttribute;
+
+  EncFS_Context *ctx = context();
+  uint64_t generation;
+  bool present;
+  string cached;
+  if (ctx->lookupXattr(path, name, &generation, &present, &cached))
+    return cachedXattr(present, cached, value, size);
+
+  int res = withCipherPath("getxattr", path, _do_getxattr,
+                           make_tuple(name, (void *)value, size), true);
+  cacheXattr(ctx, path, name, generation, res, value, size);
+  return res;
 }
 #endif
 
@@ -672,7 +839,23 @@ int _do_listxattr(EncFS_Context *, const string &cyName,
 #else
   int res = ::listxattr(cyName.c_str(), get<0>(data), get<1>(data));
 #endif
-  return (res == -1) ? -errno : res;
+  if (res == -1) return -errno;
+
+  // drop private names from the list.  A size query may overestimate.
+  char *list = get<0>(data);
+  if (list && get<1>(data)) {
+    int out = 0;
+    for (int in = 0; in < res;) {
+      int len = strlen(list + in) + 1;
+      if (!isPrivateAttribute(list + in)) {
+        memmove(list + out, list + in, len);
+        out += len;
+      }
+      in += len;
+    }
+    res = out;
+  }
+  return res;
 }
 
 int encfs_listxattr(const char *path, char *list, size_t size) {
@@ -691,7 +874,10 @@ int _do_removexattr(EncFS_Context *, const string &cyName, const char *name) {
 }
 
 int encfs_removexattr(const char *path, const char *name) {
-  return withCipherPath("removexattr", path, _do_removexattr, name);
+  if (isPrivateAttribute(name)) return -EPERM;
+  int res = withCipherPath("removexattr", path, _do_removexattr, name);
+  context()->clearXattrs(NULL);
+  return res;
 }
 
 }  // namespace encfs
@@ -82,6 +82,11 @@ int encfs_statfs(const char *, struct statvfs *fst);
 int encfs_flush(const char *, struct fuse_file_info *info);
 int encfs_fsync(const char *path, int flags, struct fuse_file_info *info);
 
+#if FUSE_VERSION >= 29
+int encfs_fallocate(const char *path, int mode, off_t offset, off_t length,
+                    struct fuse_file_info *info);
+#endif
+
 #ifdef HAVE_XATTR
 
 #ifdef XATTR_ADD_OPT
@@ -19,8 +19,12 @@ void runWithAllCiphers(void (*func)(FSConfigPtr& config));
 
 void comparisonTest(FSConfigPtr& cfg, FileIO* a, FileIO* b);
 
+void writeRandom(FSConfigPtr& cfg, FileIO* a, FileIO* b, int offset, int len);
+
 void compare(FileIO* a, FileIO* b, int offset, int len);
 
+void truncate(FileIO* a, FileIO* b, int len);
+
 }  // namespace encfs
 
 #endif
@@ -27,6 +27,7 @@
 #include "cipher/MAC.h"
 #include "cipher/StreamCipher.h"
 
+#include "fs/ChangeRecord.h"
 #include "fs/FileUtils.h"
 #include "fs/Context.h"
 #include "fs/FileNode.h"
@@ -36,13 +37,16 @@
 
 #include <iostream>
 #include <string>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <list>
 
 #include <getopt.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <dirent.h>
 
 using namespace encfs;
 using gnu::autosprintf;
@@ -65,6 +69,7 @@ static int cmd_showcruft(int argc, char **argv);
 static int cmd_cat(int argc, char **argv);
 static int cmd_export(int argc, char **argv);
 static int cmd_showKey(int argc, char **argv);
+static int cmd_changedBlocks(int argc, char **argv);
 
 struct CommandOpts {
   const char *name;
@@ -106,6 +111,11 @@ struct CommandOpts {
       {"export", 2, 2, cmd_export, "(root dir) path",
        // xgroup(usage)
        gettext_noop("  -- decrypts a volume and writes results to path")},
+      {"changed-blocks", 1, 2, cmd_changedBlocks, "[--reset] (root dir)",
+       // xgroup(usage)
+       gettext_noop(
+           "  -- show changed ranges of the encrypted files, with --reset\n"
+           "\talso start a new backup generation after the listed changes")},
       {"ciphers", 0, 0, showCiphers, "",
        // xgroup(usage)
        gettext_noop("  -- show available ciphers")},
@@ -637,6 +647,112 @@ static int cmd_showcruft(int argc, char **argv) {
   return EXIT_SUCCESS;
 }
 
+// Show the change records of the encrypted files below dir, and with reset
+// clear what was shown.
+// Returns the number of files which couldn't be handled.
+static int changedBlocks(const string &rootDir, const string &dir,
+                         bool reset) {
+  int errors = 0;
+  DIR *dp = opendir((rootDir + dir).c_str());
+  if (dp == NULL) {
+    cerr << autosprintf(_("unable to open directory %s"), dir.c_str()) << "\n";
+    return 1;
+  }
+
+  struct dirent *de;
+  while ((de = readdir(dp)) != NULL) {
+    string name = de->d_name;
+    if (name == "." || name == "..") continue;
+    if (dir.empty() && name.compare(0, 6, ".encfs") == 0) continue;
+
+    string path = dir + name;
+    string fullPath = rootDir + path;
+    struct stat st;
+    if (lstat(fullPath.c_str(), &st) != 0) continue;
+
+    if (S_ISDIR(st.st_mode)) {
+      errors += changedBlocks(rootDir, path + "/", reset);
+      continue;
+    }
+    if (!S_ISREG(st.st_mode)) continue;
+
+    ChangeRecord record;
+    int res = readChangeRecord(-1, fullPath.c_str(), &record);
+    bool tracked = (res == 0);
+    if (res < 0 && res != -ENODATA) {
+      cerr << path << ": " << strerror(-res) << "\n";
+      ++errors;
+      continue;
+    }
+
+    // path, generation, then the changed ranges as offset+length.
+    cout << path << "\t" << record.generation << "\t";
+    if (!tracked) {
+      cout << "all";
+    } else {
+      vector<std::pair<off_t, off_t> > ranges = record.ranges(st.st_size);
+      if (ranges.empty()) cout << "none";
+      for (size_t i = 0; i < ranges.size(); ++i) {
+        if (i) cout << ",";
+        cout << ranges[i].first << "+" << ranges[i].second - ranges[i].first;
+      }
+    }
+    cout << "\n";
+
+    if (!reset) continue;
+
+    // Start the next generation with whatever was marked since the record
+    // was read, so only the listed changes are cleared.
+    ChangeRecord current;
+    res = readChangeRecord(-1, fullPath.c_str(), &current);
+    if (res == -ENODATA) res = 0;
+    if (res == 0 && tracked && current.generation != record.generation) {
+      cerr << path << ": " << _("record was reset while it was listed")
+           << "\n";
+      ++errors;
+      continue;
+    }
+    if (res == 0) {
+      if (tracked)
+        current.unmark(record, st.st_size);
+      else
+        current.clear();
+      ++current.generation;
+      res = writeChangeRecord(-1, fullPath.c_str(), current);
+    }
+    if (res < 0) {
+      cerr << path << ": " << strerror(-res) << "\n";
+      ++errors;
+    }
+  }
+
+  closedir(dp);
+  return errors;
+}
+
+static int cmd_changedBlocks(int argc, char **argv) {
+  bool reset = (argc == 3);
+  if (reset && strcmp(argv[1], "--reset") != 0) {
+    cerr << _("Incorrect number of arguments") << "\n";
+    return EXIT_FAILURE;
+  }
+
+  string rootDir = argv[argc - 1];
+  if (!checkDir(rootDir)) return EXIT_FAILURE;
+
+  EncfsConfig config;
+  if (readConfig(rootDir, config) == Config_None) {
+    cout << _("Unable to load or parse config file\n");
+    return EXIT_FAILURE;
+  }
+  if (!config.change_tracking()) {
+    cout << _("Change tracking is not enabled for this filesystem\n");
+    return EXIT_FAILURE;
+  }
+
+  return changedBlocks(rootDir, "", reset) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 static int do_chpasswd(bool useStdin, bool annotate, int argc, char **argv) {
   (void)argc;
   string rootDir = argv[1];